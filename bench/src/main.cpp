@@ -0,0 +1,358 @@
+// headless benchmark of the slitscan engine (ingest, addSpace and compose) on msa::SyntheticDepthSource frames
+// sweeps gradient modes, pixel steps, scan lengths, cell counts and frame sizes and writes one csv / json row per configuration
+// "bench micro ..." runs the microbenchmarks in microbench.cpp instead
+// see ../readme.md for usage
+
+#include "ofMain.h"
+#include "MSASlitScan.h"
+#include "MSASyntheticDepthSource.h"
+#include "MSACompressedDepthFrameStore.h"
+#include "MSAMmapDepthFrameStore.h"
+
+#ifndef TARGET_WIN32
+#include <sys/resource.h>
+#endif
+
+int runMicrobenchmarks(int argc, char *argv[]);     // microbench.cpp
+
+
+//--------------------------------------------------------------
+struct Config {
+    int width, height;
+    int mode;
+    int pixelStep;
+    int numScanFrames;
+    float cellScale;    // multiplier on the gradient mode's default number of cells
+};
+
+struct Options {
+    vector<int> modes;
+    vector<int> pixelSteps;
+    vector<int> numScanFrames;
+    vector<float> cellScales;
+    vector<int> widths, heights;
+    int numFrames;      // measured frames per configuration (after filling the history)
+    int numThreads;
+    unsigned int seed;
+    bool compact;
+    bool sparse;
+    int adaptiveLeaves; // octree leaf budget, 0 for uniform cells
+    bool raw;           // keep the history as depth images, binned when composing
+    bool compress;      // and keep those compressed
+    string diskPath;    // or in this memory mapped file
+    int maxResidentMB;  // of which at most this much stays mapped in
+    bool json;
+    string outPath;
+};
+
+
+//--------------------------------------------------------------
+// peak resident set size of the process so far in MB (it never goes down, run single configurations to compare)
+float getPeakRssMB() {
+#ifdef TARGET_WIN32
+    return 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef TARGET_OSX
+    return usage.ru_maxrss / (1024.0f * 1024.0f);   // bytes
+#else
+    return usage.ru_maxrss / 1024.0f;               // kilobytes
+#endif
+#endif
+}
+
+
+//--------------------------------------------------------------
+// render frame f of the synthetic scene into frame
+void makeFrame(msa::DepthFrame &frame, msa::SyntheticDepthSource &source, int f) {
+    source.setFrameNum(f);
+    frame.setFromPixels(source.getRawDepthPixels(), source.getPixels(), source.getWidth(), source.getHeight());
+    frame.frameNum = f;
+    frame.timestamp = f * 1000000ULL / source.getFps();
+}
+
+
+//--------------------------------------------------------------
+// column names and values of one result row
+struct Row {
+    vector<string> names, values;
+
+    template <typename T>
+    void add(string name, T value) {
+        names.push_back(name);
+        values.push_back(ofToString(value));
+    }
+};
+
+
+//--------------------------------------------------------------
+Row runConfig(const Config &config, const Options &options) {
+    // the synthetic scene with the back wall beyond the far threshold, so (like a real room) only part of each frame is kept
+    msa::SyntheticDepthSource source;
+    source.wallDepth = 3500;
+    source.setRealtime(false);
+    source.setup(config.width, config.height, 30, options.seed);
+    
+    msa::SlitScan slitScan;
+    slitScan.getDepthToWorld().setup(source, config.width, config.height);
+    slitScan.setup(options.numThreads);
+    slitScan.setPixelStep(config.pixelStep);
+    slitScan.setNumScanFrames(config.numScanFrames);
+    slitScan.setCompact(options.compact);
+    slitScan.setSparse(options.sparse);
+    slitScan.setAdaptive(options.adaptiveLeaves > 0);
+    if(options.adaptiveLeaves > 0) slitScan.setAdaptiveMaxLeaves(options.adaptiveLeaves);
+    msa::CompressedDepthFrameStore compressedStore;
+    msa::MmapDepthFrameStore diskStore;
+    if(options.compress) slitScan.setFrameStore(&compressedStore);
+    if(!options.diskPath.empty()) {
+        diskStore.setPath(options.diskPath);
+        diskStore.setMaxResidentBytes((size_t)options.maxResidentMB * 1024 * 1024);
+        slitScan.setFrameStore(&diskStore);
+    }
+    slitScan.setRawHistory(options.raw);
+    slitScan.setGradientMode(config.mode);
+    ofVec3f numCells = msa::SlitScan::getGradientModeNumCells(config.mode);
+    ofVec3f scaledCells = numCells * config.cellScale;
+    slitScan.setNumCells(ofVec3f(numCells.x > 1 ? scaledCells.x : 1, numCells.y > 1 ? scaledCells.y : 1, numCells.z > 1 ? scaledCells.z : 1));
+    numCells = slitScan.getNumCells();
+
+    msa::DepthFrame frame;
+    vector<ofVec3f> vertices;
+    vector<ofFloatColor> colors;
+
+    // fill the history so composition sees a full scan
+    for(int f=0; f<config.numScanFrames; f++) {
+        makeFrame(frame, source, f);
+        if(options.raw) slitScan.addFrame(frame);
+        else slitScan.addSpace(slitScan.ingest(frame));
+    }
+    slitScan.compose(vertices, colors);
+
+    unsigned long long ingestMicros = 0, composeMicros = 0;
+    double inputPoints = 0, outputPoints = 0, leaves = 0;
+    double tilesDecoded = 0, decodeMicros = 0;
+    for(int f=0; f<options.numFrames; f++) {
+        makeFrame(frame, source, config.numScanFrames + f);
+
+        unsigned long long t0 = ofGetElapsedTimeMicros();
+        unsigned long long t1;
+        if(options.raw) {
+            // ingest is storing the images, input points are the pixels with depth
+            slitScan.addFrame(frame);
+            t1 = ofGetElapsedTimeMicros();
+            for(int j=0; j<config.height; j+=config.pixelStep) {
+                for(int i=0; i<config.width; i+=config.pixelStep) inputPoints += frame.depth[j * config.width + i] > 0;
+            }
+        } else {
+            msa::PointSpace *space = slitScan.ingest(frame);
+            t1 = ofGetElapsedTimeMicros();
+            inputPoints += space->getNumPoints();
+            slitScan.addSpace(space);
+        }
+        slitScan.compose(vertices, colors);
+        unsigned long long t2 = ofGetElapsedTimeMicros();
+
+        ingestMicros += t1 - t0;
+        composeMicros += t2 - t1;
+        outputPoints += vertices.size();
+        leaves += slitScan.getNumLeaves();
+        tilesDecoded += compressedStore.getNumTilesDecoded();
+        decodeMicros += compressedStore.getDecodeMicros();
+    }
+    int numThreads = slitScan.getComposePool().getNumThreads();
+    slitScan.stop();
+
+    double seconds = (ingestMicros + composeMicros) / 1000000.0;
+    int n = options.numFrames;
+    Row row;
+    row.add("width", config.width);
+    row.add("height", config.height);
+    row.add("mode", config.mode);
+    row.add("pixel_step", config.pixelStep);
+    row.add("num_scan_frames", config.numScanFrames);
+    row.add("cells_x", numCells.x);
+    row.add("cells_y", numCells.y);
+    row.add("cells_z", numCells.z);
+    row.add("compact", options.compact);
+    row.add("sparse", options.sparse);
+    row.add("adaptive_leaves", options.adaptiveLeaves);
+    row.add("leaves", leaves / n);
+    row.add("raw", options.raw);
+    row.add("compress", options.compress);
+    row.add("tiles_decoded", tilesDecoded / n);
+    row.add("decode_ms", decodeMicros / 1000.0 / n);
+    row.add("disk", !options.diskPath.empty());
+    row.add("threads", numThreads);
+    row.add("frames", n);
+    row.add("fps", n / seconds);
+    row.add("ms_per_frame", seconds * 1000 / n);
+    row.add("ingest_ms", ingestMicros / 1000.0 / n);
+    row.add("compose_ms", composeMicros / 1000.0 / n);
+    row.add("input_points", inputPoints / n);
+    row.add("output_points", outputPoints / n);
+    row.add("points_per_s", inputPoints / seconds);
+    row.add("ns_per_point", inputPoints > 0 ? seconds * 1e9 / inputPoints : 0);
+    row.add("history_mb", slitScan.getHistoryBytes() / (1024.0f * 1024.0f));
+    row.add("peak_rss_mb", getPeakRssMB());
+    return row;
+}
+
+
+//--------------------------------------------------------------
+// comma separated list of numbers
+vector<int> parseInts(string s) {
+    vector<int> values;
+    vector<string> items = ofSplitString(s, ",", true, true);
+    for(int i=0; i<items.size(); i++) values.push_back(ofToInt(items[i]));
+    return values;
+}
+
+vector<float> parseFloats(string s) {
+    vector<float> values;
+    vector<string> items = ofSplitString(s, ",", true, true);
+    for(int i=0; i<items.size(); i++) values.push_back(ofToFloat(items[i]));
+    return values;
+}
+
+//--------------------------------------------------------------
+void printUsage() {
+    printf("usage: bench [options]\n"
+           "       bench micro [names...] [--json] [--out path]   (microbenchmarks, see microbench.cpp)\n"
+           "  --modes 0,1,...       gradient modes (default 0-9)\n"
+           "  --steps 1,2,...       pixel steps (default 1)\n"
+           "  --scan 240,...        numScanFrames (default 240)\n"
+           "  --cells 1,2,...       cell count multipliers (default 1)\n"
+           "  --sizes 640x480,...   frame sizes (default 640x480)\n"
+           "  --all                 sweep everything: steps 1,2,4 scan 60,240 cells 0.5,1,2 sizes 640x480,1280x960\n"
+           "  --frames n            measured frames per configuration (default 60)\n"
+           "  --threads n           worker threads, 0 for one per core (default 0)\n"
+           "  --seed n              synthetic scene seed (default 0)\n"
+           "  --compact             store history quantized\n"
+           "  --sparse              store only occupied cells of the history\n"
+           "  --adaptive n          compose through an octree of up to n leaves (256 x 256 x 256 at the finest) instead of --cells\n"
+           "  --raw                 keep the history as depth images and bin them when composing\n"
+           "  --compress            keep the --raw history compressed (implies --raw)\n"
+           "  --disk path           keep the --raw history in a memory mapped file (implies --raw)\n"
+           "  --rss mb              most of the --disk file mapped in at once (default 1024)\n"
+           "  --json                write json instead of csv\n"
+           "  --out path            write to file instead of stdout\n");
+}
+
+//--------------------------------------------------------------
+int main(int argc, char *argv[]) {
+    if(argc > 1 && string(argv[1]) == "micro") return runMicrobenchmarks(argc - 2, argv + 2);
+    
+    Options options;
+    for(int m=0; m<10; m++) options.modes.push_back(m);
+    options.pixelSteps.push_back(1);
+    options.numScanFrames.push_back(240);
+    options.cellScales.push_back(1);
+    options.widths.push_back(640);
+    options.heights.push_back(480);
+    options.numFrames = 60;
+    options.numThreads = 0;
+    options.seed = 0;
+    options.compact = false;
+    options.sparse = false;
+    options.adaptiveLeaves = 0;
+    options.raw = false;
+    options.compress = false;
+    options.maxResidentMB = 1024;
+    options.json = false;
+
+    for(int i=1; i<argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--modes" && hasValue) options.modes = parseInts(argv[++i]);
+        else if(arg == "--steps" && hasValue) options.pixelSteps = parseInts(argv[++i]);
+        else if(arg == "--scan" && hasValue) options.numScanFrames = parseInts(argv[++i]);
+        else if(arg == "--cells" && hasValue) options.cellScales = parseFloats(argv[++i]);
+        else if(arg == "--sizes" && hasValue) {
+            vector<string> sizes = ofSplitString(argv[++i], ",", true, true);
+            options.widths.clear();
+            options.heights.clear();
+            for(int s=0; s<sizes.size(); s++) {
+                vector<string> wh = ofSplitString(sizes[s], "x");
+                if(wh.size() != 2) continue;
+                options.widths.push_back(ofToInt(wh[0]));
+                options.heights.push_back(ofToInt(wh[1]));
+            }
+        }
+        else if(arg == "--all") {
+            options.pixelSteps = parseInts("1,2,4");
+            options.numScanFrames = parseInts("60,240");
+            options.cellScales = parseFloats("0.5,1,2");
+            options.widths = parseInts("640,1280");
+            options.heights = parseInts("480,960");
+        }
+        else if(arg == "--frames" && hasValue) options.numFrames = max(1, ofToInt(argv[++i]));
+        else if(arg == "--threads" && hasValue) options.numThreads = ofToInt(argv[++i]);
+        else if(arg == "--seed" && hasValue) options.seed = ofToInt(argv[++i]);
+        else if(arg == "--compact") options.compact = true;
+        else if(arg == "--sparse") options.sparse = true;
+        else if(arg == "--adaptive" && hasValue) options.adaptiveLeaves = max(0, ofToInt(argv[++i]));
+        else if(arg == "--raw") options.raw = true;
+        else if(arg == "--compress") options.raw = options.compress = true;
+        else if(arg == "--disk" && hasValue) {
+            options.raw = true;
+            options.diskPath = argv[++i];
+        }
+        else if(arg == "--rss" && hasValue) options.maxResidentMB = max(1, ofToInt(argv[++i]));
+        else if(arg == "--json") options.json = true;
+        else if(arg == "--out" && hasValue) options.outPath = argv[++i];
+        else {
+            printUsage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    FILE *out = stdout;
+    if(!options.outPath.empty()) {
+        out = fopen(options.outPath.c_str(), "w");
+        if(out == NULL) {
+            fprintf(stderr, "can't open %s\n", options.outPath.c_str());
+            return 1;
+        }
+    }
+
+    int numRows = 0;
+    if(options.json) fprintf(out, "[\n");
+    for(int s=0; s<options.widths.size(); s++) {
+        for(int m=0; m<options.modes.size(); m++) {
+            for(int p=0; p<options.pixelSteps.size(); p++) {
+                for(int n=0; n<options.numScanFrames.size(); n++) {
+                    for(int c=0; c<options.cellScales.size(); c++) {
+                        Config config;
+                        config.width = options.widths[s];
+                        config.height = options.heights[s];
+                        config.mode = options.modes[m];
+                        config.pixelStep = options.pixelSteps[p];
+                        config.numScanFrames = options.numScanFrames[n];
+                        config.cellScale = options.cellScales[c];
+                        Row row = runConfig(config, options);
+
+                        if(options.json) {
+                            fprintf(out, "%s  {", numRows ? ",\n" : "");
+                            for(int i=0; i<row.names.size(); i++) fprintf(out, "%s\"%s\": %s", i ? ", " : "", row.names[i].c_str(), row.values[i].c_str());
+                            fprintf(out, "}");
+                        } else {
+                            if(numRows == 0) {
+                                for(int i=0; i<row.names.size(); i++) fprintf(out, "%s%s", i ? "," : "", row.names[i].c_str());
+                                fprintf(out, "\n");
+                            }
+                            for(int i=0; i<row.values.size(); i++) fprintf(out, "%s%s", i ? "," : "", row.values[i].c_str());
+                            fprintf(out, "\n");
+                        }
+                        fflush(out);
+                        numRows++;
+                    }
+                }
+            }
+        }
+    }
+    if(options.json) fprintf(out, "\n]\n");
+    if(out != stdout) fclose(out);
+    return 0;
+}
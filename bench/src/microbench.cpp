@@ -0,0 +1,305 @@
+// microbenchmarks of the SpaceT / SpaceTime / PointSpace primitives at realistic cell counts and history lengths
+// run with: bench micro [names...] [--json] [--out path]
+
+#include "ofMain.h"
+#include "MSASpaceTime.h"
+
+
+//--------------------------------------------------------------
+// cell counts of the gradient modes (2 to 64000 cells in total)
+static const int numGridSizes = 4;
+static const float gridSizes[numGridSizes][3] = { { 2, 1, 1 }, { 500, 1, 1 }, { 30, 30, 30 }, { 40, 40, 40 } };
+
+// history lengths (1 second to 2 minutes at 30 fps)
+static const int numHistoryLengths = 5;
+static const int historyLengths[numHistoryLengths] = { 30, 240, 960, 1920, 3600 };
+
+static const ofVec3f boundaryMin(-400, -400, 400);
+static const ofVec3f boundaryMax(400, 400, 3000);
+
+static volatile float sink;     // keeps results alive so the optimizer can't drop the measured work
+
+
+//--------------------------------------------------------------
+// deterministic pseudo random numbers, so every run measures the same work
+class Random {
+public:
+    Random(unsigned int seed = 1) : state(seed) {}
+
+    float uniform() {
+        state = state * 1664525 + 1013904223;
+        return (state >> 8) / 16777216.0f;
+    }
+
+    ofVec3f position() {
+        // a bit outside the boundaries too, so clamping is exercised
+        float x = uniform(), y = uniform(), z = uniform();
+        return ofVec3f(ofLerp(boundaryMin.x - 50, boundaryMax.x + 50, x), ofLerp(boundaryMin.y - 50, boundaryMax.y + 50, y), ofLerp(boundaryMin.z - 50, boundaryMax.z + 50, z));
+    }
+
+protected:
+    unsigned int state;
+};
+
+
+//--------------------------------------------------------------
+struct Result {
+    string name;
+    int numCells;
+    int numFrames;
+    double numOps;
+    double nanosPerOp;
+};
+
+static vector<Result> results;
+
+//--------------------------------------------------------------
+// runs bench.run(n) with growing n until it takes at least 0.2 seconds, and records ns per op
+template <typename Bench>
+void measure(string name, int numCells, int numFrames, Bench &bench, int opsPerRun) {
+    int n = 1;
+    unsigned long long micros = 0;
+    while(true) {
+        unsigned long long t0 = ofGetElapsedTimeMicros();
+        bench.run(n);
+        micros = ofGetElapsedTimeMicros() - t0;
+        if(micros > 200000 || n >= (1 << 24)) break;
+        n *= micros < 20000 ? 8 : 2;
+    }
+
+    Result r;
+    r.name = name;
+    r.numCells = numCells;
+    r.numFrames = numFrames;
+    r.numOps = (double)n * opsPerRun;
+    r.nanosPerOp = micros * 1000.0 / r.numOps;
+    results.push_back(r);
+    fprintf(stderr, "%-24s cells %6d frames %5d: %8.2f ns/op\n", name.c_str(), numCells, numFrames, r.nanosPerOp);
+}
+
+
+//--------------------------------------------------------------
+// SpaceGrid::getIndexForPosition, one position at a time
+struct IndexForPositionBench {
+    msa::SpaceT<float> *space;
+    vector<ofVec3f> positions;
+
+    void run(int n) {
+        float sum = 0;
+        for(int r=0; r<n; r++) {
+            for(int i=0; i<positions.size(); i++) sum += space->getIndexForPosition(positions[i]).x;
+        }
+        sink = sum;
+    }
+};
+
+//--------------------------------------------------------------
+// SpaceGrid::cellIndicesForPositions, the batched path used when binning
+struct CellIndicesBench {
+    msa::SpaceT<float> *space;
+    vector<ofVec3f> positions;
+    vector<unsigned int> indices;
+
+    void run(int n) {
+        for(int r=0; r<n; r++) space->cellIndicesForPositions(&positions[0], &indices[0], positions.size());
+        sink = indices[0];
+    }
+};
+
+//--------------------------------------------------------------
+// SpaceT::getDataAtIndex at random cells
+struct DataAtIndexBench {
+    msa::SpaceT<float> *space;
+    vector<ofVec3f> indices;
+
+    void run(int n) {
+        float sum = 0;
+        for(int r=0; r<n; r++) {
+            for(int i=0; i<indices.size(); i++) sum += space->getDataAtIndex(indices[i].x, indices[i].y, indices[i].z);
+        }
+        sink = sum;
+    }
+};
+
+//--------------------------------------------------------------
+// SpaceTime::addSpace into a full history, recycling the evicted space through the pool
+struct AddSpaceBench {
+    msa::SpacePool<msa::PointSpace> *pool;
+    msa::SpaceTime<msa::PointSpace> *spaceTime;
+    ofVec3f numCells;
+
+    void run(int n) {
+        for(int r=0; r<n; r++) spaceTime->addSpace(pool->getSpace(numCells, boundaryMin, boundaryMax));
+        sink = spaceTime->getNumFrames();
+    }
+};
+
+//--------------------------------------------------------------
+// SpaceTime::getSpaceAtTime at random times
+struct SpaceAtTimeBench {
+    msa::SpaceTime<msa::PointSpace> *spaceTime;
+    vector<float> times;
+
+    void run(int n) {
+        size_t sum = 0;
+        for(int r=0; r<n; r++) {
+            for(int i=0; i<times.size(); i++) sum += (size_t)spaceTime->getSpaceAtTime(times[i]);
+        }
+        sink = sum;
+    }
+};
+
+//--------------------------------------------------------------
+// PointSpace::copyCellPoints of every cell into one output mesh, as the composer does
+struct CellAppendBench {
+    msa::PointSpace *space;
+    vector<ofVec3f> vertices;
+    vector<ofFloatColor> colors;
+
+    void run(int n) {
+        for(int r=0; r<n; r++) {
+            int o = 0;
+            for(int c=0; c<space->getNumCellsTotal(); c++) {
+                space->copyCellPoints(c, &vertices[o], &colors[o]);
+                o += space->getCellNumPoints(c);
+            }
+        }
+        sink = vertices[0].x;
+    }
+};
+
+
+//--------------------------------------------------------------
+void benchIndexForPosition() {
+    for(int g=0; g<numGridSizes; g++) {
+        msa::SpaceT<float> space(ofVec3f(gridSizes[g][0], gridSizes[g][1], gridSizes[g][2]), boundaryMin, boundaryMax);
+        Random random;
+        IndexForPositionBench bench;
+        bench.space = &space;
+        for(int i=0; i<4096; i++) bench.positions.push_back(random.position());
+        measure("getIndexForPosition", space.getNumCellsTotal(), 0, bench, bench.positions.size());
+
+        CellIndicesBench batch;
+        batch.space = &space;
+        batch.positions = bench.positions;
+        batch.indices.resize(batch.positions.size());
+        measure("cellIndicesForPositions", space.getNumCellsTotal(), 0, batch, batch.positions.size());
+    }
+}
+
+//--------------------------------------------------------------
+void benchDataAtIndex() {
+    for(int g=0; g<numGridSizes; g++) {
+        msa::SpaceT<float> space(ofVec3f(gridSizes[g][0], gridSizes[g][1], gridSizes[g][2]), boundaryMin, boundaryMax);
+        Random random;
+        DataAtIndexBench bench;
+        bench.space = &space;
+        for(int i=0; i<4096; i++) bench.indices.push_back(space.getIndexForPosition(random.position()));
+        measure("getDataAtIndex", space.getNumCellsTotal(), 0, bench, bench.indices.size());
+    }
+}
+
+//--------------------------------------------------------------
+void benchAddSpace() {
+    for(int g=0; g<numGridSizes; g++) {
+        ofVec3f numCells(gridSizes[g][0], gridSizes[g][1], gridSizes[g][2]);
+        for(int h=0; h<numHistoryLengths; h++) {
+            msa::SpacePool<msa::PointSpace> pool;
+            msa::SpaceTime<msa::PointSpace> spaceTime;
+            spaceTime.setPool(&pool);
+            spaceTime.setMaxFrames(historyLengths[h]);
+            for(int f=0; f<historyLengths[h]; f++) spaceTime.addSpace(pool.getSpace(numCells, boundaryMin, boundaryMax));
+
+            AddSpaceBench bench;
+            bench.pool = &pool;
+            bench.spaceTime = &spaceTime;
+            bench.numCells = numCells;
+            measure("addSpace", numCells.x * numCells.y * numCells.z, historyLengths[h], bench, 1);
+            spaceTime.clear();
+        }
+    }
+}
+
+//--------------------------------------------------------------
+void benchSpaceAtTime() {
+    for(int h=0; h<numHistoryLengths; h++) {
+        msa::SpaceTime<msa::PointSpace> spaceTime;
+        spaceTime.setMaxFrames(historyLengths[h]);
+        for(int f=0; f<historyLengths[h]; f++) spaceTime.addSpace(new msa::PointSpace(ofVec3f(2, 1, 1), boundaryMin, boundaryMax));
+
+        Random random;
+        SpaceAtTimeBench bench;
+        bench.spaceTime = &spaceTime;
+        for(int i=0; i<4096; i++) bench.times.push_back(random.uniform());
+        measure("getSpaceAtTime", 2, historyLengths[h], bench, bench.times.size());
+    }
+}
+
+//--------------------------------------------------------------
+void benchCellAppend() {
+    // about one kinect frame of points in range
+    int numPoints = 100000;
+    const char *names[] = { "copyCellPoints", "copyCellPoints compact", "copyCellPoints sparse" };
+    for(int format=0; format<3; format++) {
+        for(int g=0; g<numGridSizes; g++) {
+            msa::PointSpace space(ofVec3f(gridSizes[g][0], gridSizes[g][1], gridSizes[g][2]), boundaryMin, boundaryMax, msa::SpaceFormat(format == 1, format == 2));
+            msa::PointSpaceBuilder builder;
+            builder.setNumBands(1);
+            Random random;
+            for(int i=0; i<numPoints; i++) builder.getBand(0).addPoint(random.position(), ofFloatColor(random.uniform(), random.uniform(), random.uniform()));
+            builder.build(space);
+
+            CellAppendBench bench;
+            bench.space = &space;
+            bench.vertices.resize(space.getNumPoints());
+            bench.colors.resize(space.getNumPoints());
+            measure(names[format], space.getNumCellsTotal(), 0, bench, space.getNumPoints());
+        }
+    }
+}
+
+
+//--------------------------------------------------------------
+int runMicrobenchmarks(int argc, char *argv[]) {
+    vector<string> names;
+    bool json = false;
+    string outPath;
+    for(int i=0; i<argc; i++) {
+        string arg = argv[i];
+        if(arg == "--json") json = true;
+        else if(arg == "--out" && i + 1 < argc) outPath = argv[++i];
+        else if(arg.size() > 0 && arg[0] == '-') {
+            printf("usage: bench micro [index] [data] [addSpace] [spaceAtTime] [cellAppend] [--json] [--out path]\n");
+            return arg == "--help" ? 0 : 1;
+        }
+        else names.push_back(arg);
+    }
+    bool all = names.empty();
+    #define SELECTED(name) (all || find(names.begin(), names.end(), string(name)) != names.end())
+
+    if(SELECTED("index")) benchIndexForPosition();
+    if(SELECTED("data")) benchDataAtIndex();
+    if(SELECTED("addSpace")) benchAddSpace();
+    if(SELECTED("spaceAtTime")) benchSpaceAtTime();
+    if(SELECTED("cellAppend")) benchCellAppend();
+    #undef SELECTED
+
+    FILE *out = stdout;
+    if(!outPath.empty()) {
+        out = fopen(outPath.c_str(), "w");
+        if(out == NULL) {
+            fprintf(stderr, "can't open %s\n", outPath.c_str());
+            return 1;
+        }
+    }
+    if(json) fprintf(out, "[\n");
+    else fprintf(out, "benchmark,cells,frames,ops,ns_per_op\n");
+    for(int i=0; i<results.size(); i++) {
+        Result &r = results[i];
+        if(json) fprintf(out, "%s  {\"benchmark\": \"%s\", \"cells\": %d, \"frames\": %d, \"ops\": %.0f, \"ns_per_op\": %f}", i ? ",\n" : "", r.name.c_str(), r.numCells, r.numFrames, r.numOps, r.nanosPerOp);
+        else fprintf(out, "%s,%d,%d,%.0f,%f\n", r.name.c_str(), r.numCells, r.numFrames, r.numOps, r.nanosPerOp);
+    }
+    if(json) fprintf(out, "\n]\n");
+    if(out != stdout) fclose(out);
+    return 0;
+}
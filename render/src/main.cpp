@@ -0,0 +1,266 @@
+// offline renderer: runs the slitscan engine over a recording made with the app ('r', msa::DepthRecorder)
+// and writes the composed point cloud of every frame as binary PLY, as fast as the cores allow
+// no window or frame rate limit, so any gradient mode and cell resolution can be rendered, however slow
+// see ../readme.md for usage
+
+#include "ofMain.h"
+#include "MSASlitScan.h"
+#include "MSADepthRecorder.h"
+#include "MSAPlyWriter.h"
+#include "MSACompressedDepthFrameStore.h"
+#include "MSAMmapDepthFrameStore.h"
+#include <climits>
+
+
+//--------------------------------------------------------------
+struct Options {
+    string inPath;
+    string outDir;
+    string prefix;
+    int mode;
+    vector<float> cells;    // empty for the mode's default, one value for a total number of cells, or x,y,z
+    int pixelStep;
+    int numScanFrames;
+    float nearThreshold, farThreshold;
+    ofVec3f boundaryMin, boundaryMax;
+    int numThreads;
+    bool compact;
+    bool sparse;
+    int adaptiveLeaves;     // octree leaf budget, 0 for uniform cells
+    bool raw;               // keep the history as depth images, binned when composing
+    bool compress;          // and keep those compressed
+    string diskPath;        // or in this memory mapped file
+    int maxResidentMB;      // of which at most this much stays mapped in
+    int from, to;           // range of frames written (all frames before are still ingested to fill the history)
+    int every;              // write every n-th frame
+    bool write;
+    unsigned int seed;      // for the random gradient mode
+};
+
+
+//--------------------------------------------------------------
+// comma separated list of numbers
+vector<float> parseFloats(string s) {
+    vector<float> values;
+    vector<string> items = ofSplitString(s, ",", true, true);
+    for(int i=0; i<items.size(); i++) values.push_back(ofToFloat(items[i]));
+    return values;
+}
+
+//--------------------------------------------------------------
+ofVec3f parseVec3f(string s) {
+    vector<float> v = parseFloats(s);
+    return v.size() == 3 ? ofVec3f(v[0], v[1], v[2]) : ofVec3f();
+}
+
+//--------------------------------------------------------------
+// cells for mode: x,y,z as given, or a single total spread evenly over the axes the mode scans along
+// (e.g. 4096 is 4096 x 1 x 1 for left-right and 16 x 16 x 16 for spherical)
+ofVec3f getNumCells(int mode, const vector<float> &cells) {
+    ofVec3f numCells = msa::SlitScan::getGradientModeNumCells(mode);
+    if(cells.size() == 3) return ofVec3f(cells[0], cells[1], cells[2]);
+    if(cells.size() != 1) return numCells;
+
+    int numAxes = (numCells.x > 1) + (numCells.y > 1) + (numCells.z > 1);
+    float n = max(1.0f, roundf(powf(cells[0], 1.0f / max(numAxes, 1))));
+    return ofVec3f(numCells.x > 1 ? n : 1, numCells.y > 1 ? n : 1, numCells.z > 1 ? n : 1);
+}
+
+//--------------------------------------------------------------
+void printUsage() {
+    printf("usage: render recording.msadepth [options]\n"
+           "  --out dir             output folder (default render)\n"
+           "  --prefix name         output file name prefix (default frame_)\n"
+           "  --mode n              gradient mode 0-9 (default 1)\n"
+           "  --cells n | x,y,z     total cells spread over the mode's axes, or cells per axis (default: the mode's)\n"
+           "  --step n              pixel step (default 1)\n"
+           "  --scan n              numScanFrames (default 240)\n"
+           "  --near mm, --far mm   depth thresholds (default 0, 3000)\n"
+           "  --bmin x,y,z          space boundaries (default -400,-400,400 and 400,400,3000)\n"
+           "  --bmax x,y,z\n"
+           "  --threads n           worker threads, 0 for one per core (default 0)\n"
+           "  --compact             store history quantized\n"
+           "  --sparse              store only occupied cells of the history (for fine 3D grids)\n"
+           "  --adaptive n          compose through an octree of up to n leaves (256 x 256 x 256 at the finest) instead of --cells\n"
+           "  --raw                 keep the history as depth images and bin them when composing\n"
+           "  --compress            keep the --raw history compressed, for long scans (implies --raw)\n"
+           "  --disk path           keep the --raw history in a memory mapped file, for very long scans (implies --raw)\n"
+           "  --rss mb              most of the --disk file mapped in at once (default 1024)\n"
+           "  --from n, --to n      range of frames to write (default all, earlier frames still fill the history)\n"
+           "  --every n             write every n-th frame (default 1)\n"
+           "  --seed n              random seed for gradient mode 8 (default 0)\n"
+           "  --dry                 don't write anything, only time the rendering\n");
+}
+
+//--------------------------------------------------------------
+int main(int argc, char *argv[]) {
+    Options options;
+    options.outDir = "render";
+    options.prefix = "frame_";
+    options.mode = 1;
+    options.pixelStep = 1;
+    options.numScanFrames = 240;
+    options.nearThreshold = 0;
+    options.farThreshold = 3000;
+    options.boundaryMin.set(-400, -400, 400);
+    options.boundaryMax.set(400, 400, 3000);
+    options.numThreads = 0;
+    options.compact = false;
+    options.sparse = false;
+    options.adaptiveLeaves = 0;
+    options.raw = false;
+    options.compress = false;
+    options.maxResidentMB = 1024;
+    options.from = 0;
+    options.to = INT_MAX;
+    options.every = 1;
+    options.write = true;
+    options.seed = 0;
+
+    for(int i=1; i<argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--out" && hasValue) options.outDir = argv[++i];
+        else if(arg == "--prefix" && hasValue) options.prefix = argv[++i];
+        else if(arg == "--mode" && hasValue) options.mode = ofClamp(ofToInt(argv[++i]), 0, 9);
+        else if(arg == "--cells" && hasValue) options.cells = parseFloats(argv[++i]);
+        else if(arg == "--step" && hasValue) options.pixelStep = max(1, ofToInt(argv[++i]));
+        else if(arg == "--scan" && hasValue) options.numScanFrames = max(1, ofToInt(argv[++i]));
+        else if(arg == "--near" && hasValue) options.nearThreshold = ofToFloat(argv[++i]);
+        else if(arg == "--far" && hasValue) options.farThreshold = ofToFloat(argv[++i]);
+        else if(arg == "--bmin" && hasValue) options.boundaryMin = parseVec3f(argv[++i]);
+        else if(arg == "--bmax" && hasValue) options.boundaryMax = parseVec3f(argv[++i]);
+        else if(arg == "--threads" && hasValue) options.numThreads = ofToInt(argv[++i]);
+        else if(arg == "--compact") options.compact = true;
+        else if(arg == "--sparse") options.sparse = true;
+        else if(arg == "--adaptive" && hasValue) options.adaptiveLeaves = max(0, ofToInt(argv[++i]));
+        else if(arg == "--raw") options.raw = true;
+        else if(arg == "--compress") options.raw = options.compress = true;
+        else if(arg == "--disk" && hasValue) {
+            options.raw = true;
+            options.diskPath = argv[++i];
+        }
+        else if(arg == "--rss" && hasValue) options.maxResidentMB = max(1, ofToInt(argv[++i]));
+        else if(arg == "--from" && hasValue) options.from = ofToInt(argv[++i]);
+        else if(arg == "--to" && hasValue) options.to = ofToInt(argv[++i]);
+        else if(arg == "--every" && hasValue) options.every = max(1, ofToInt(argv[++i]));
+        else if(arg == "--seed" && hasValue) options.seed = ofToInt(argv[++i]);
+        else if(arg == "--dry") options.write = false;
+        else if(arg.size() > 0 && arg[0] != '-' && options.inPath.empty()) options.inPath = arg;
+        else {
+            printUsage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    if(options.inPath.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    // paths are relative to the working directory, not an app data folder
+    ofDisableDataPath();
+    ofSeedRandom(options.seed);
+
+    msa::DepthPlayer player;
+    player.setRealtime(false);
+    player.setLoop(false);
+    if(!player.load(options.inPath) || player.getNumFrames() == 0) {
+        fprintf(stderr, "can't read %s\n", options.inPath.c_str());
+        return 1;
+    }
+    int width = player.getWidth();
+    int height = player.getHeight();
+
+    if(options.write && !ofDirectory::doesDirectoryExist(options.outDir) && !ofDirectory::createDirectory(options.outDir, true, true)) {
+        fprintf(stderr, "can't create %s\n", options.outDir.c_str());
+        return 1;
+    }
+
+    msa::SlitScan slitScan;
+    msa::DepthToWorld &rays = slitScan.getDepthToWorld();
+    rays.allocate(width, height);
+    memcpy(rays.getRaysX(), &player.getRaysX()[0], width * height * sizeof(float));
+    memcpy(rays.getRaysY(), &player.getRaysY()[0], width * height * sizeof(float));
+    slitScan.setup(options.numThreads);
+    slitScan.setThresholds(options.nearThreshold, options.farThreshold);
+    slitScan.setBoundaries(options.boundaryMin, options.boundaryMax);
+    slitScan.setPixelStep(options.pixelStep);
+    slitScan.setNumScanFrames(options.numScanFrames);
+    slitScan.setCompact(options.compact);
+    slitScan.setSparse(options.sparse);
+    slitScan.setAdaptive(options.adaptiveLeaves > 0);
+    if(options.adaptiveLeaves > 0) slitScan.setAdaptiveMaxLeaves(options.adaptiveLeaves);
+    msa::CompressedDepthFrameStore compressedStore;
+    msa::MmapDepthFrameStore diskStore;
+    if(options.compress) slitScan.setFrameStore(&compressedStore);
+    if(!options.diskPath.empty()) {
+        diskStore.setPath(options.diskPath);
+        diskStore.setMaxResidentBytes((size_t)options.maxResidentMB * 1024 * 1024);
+        slitScan.setFrameStore(&diskStore);
+    }
+    slitScan.setRawHistory(options.raw);
+    slitScan.setGradientMode(options.mode);
+    slitScan.setNumCells(getNumCells(options.mode, options.cells));
+    ofVec3f numCells = slitScan.getNumCells();
+
+    int lastFrame = min(options.to, player.getNumFrames() - 1);
+    fprintf(stderr, "%s: %d frames %dx%d, mode %d (%s), cells %g x %g x %g, %d threads\n", options.inPath.c_str(), player.getNumFrames(), width, height,
+            options.mode, msa::SlitScan::getGradientModeName(options.mode).c_str(), numCells.x, numCells.y, numCells.z, slitScan.getComposePool().getNumThreads());
+
+    // clouds are written on another thread while the next frames are rendered, waiting only if it falls behind
+    msa::PlyExporter exporter;
+    if(options.write) exporter.setup(4, true);
+    
+    msa::DepthFrame frame;
+    vector<ofVec3f> vertices;
+    vector<ofFloatColor> colors;
+    unsigned long long startMicros = ofGetElapsedTimeMicros();
+    int numWritten = 0;
+    double numPointsWritten = 0;
+
+    for(int f=0; f<=lastFrame; f++) {
+        if(f > 0) player.update();
+        frame.setFromPixels(player.getRawDepthPixels(), player.getPixels(), width, height);
+        frame.frameNum = f;
+        frame.timestamp = player.getTimestamp();
+        if(options.raw) slitScan.addFrame(frame);
+        else slitScan.addSpace(slitScan.ingest(frame));
+
+        // frames which aren't written only fill the history, except in random mode, where every composition
+        // draws from the seeded random numbers and skipping some would change the frames which are written
+        bool written = f >= options.from && (f - options.from) % options.every == 0;
+        if(written || options.mode == 8) slitScan.compose(vertices, colors);
+        if(slitScan.getHistoryFailed()) {
+            fprintf(stderr, "the history's frame store failed at frame %d (see above), stopping\n", f);
+            slitScan.stop();
+            exporter.stop();
+            return 1;
+        }
+        if(!written) continue;
+
+        numPointsWritten += vertices.size();
+        numWritten++;
+        if(options.write) {
+            char name[32];
+            snprintf(name, sizeof(name), "%06d.ply", f);
+            exporter.save(options.outDir + "/" + options.prefix + name, vertices, colors);
+            if(exporter.getNumFailed() > 0) break;
+        }
+
+        if(numWritten % 30 == 0) {
+            float seconds = (ofGetElapsedTimeMicros() - startMicros) / 1000000.0f;
+            fprintf(stderr, "frame %d / %d, %.1f fps\n", f, lastFrame, (f + 1) / seconds);
+        }
+    }
+    slitScan.stop();
+    exporter.stop();
+    if(exporter.getNumFailed() > 0) {
+        fprintf(stderr, "%s\n", exporter.getStatus().c_str());
+        return 1;
+    }
+
+    float seconds = (ofGetElapsedTimeMicros() - startMicros) / 1000000.0f;
+    fprintf(stderr, "rendered %d frames in %.1f s (%.1f fps), wrote %d clouds of %.0f points on average\n",
+            lastFrame + 1, seconds, (lastFrame + 1) / seconds, numWritten, numWritten ? numPointsWritten / numWritten : 0);
+    return 0;
+}
@@ -0,0 +1,377 @@
+#pragma once
+
+#include "ofMain.h"
+#include "MSADepthFrameStore.h"
+#include "MSADepthCodec.h"
+#include <map>
+#include <list>
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // stores frames compressed in tiles, so long histories fit in memory:
+    // depth losslessly with DepthCodec (each tile on its own), color as YCbCr 4:2:0 (1.5 bytes per pixel)
+    // reads decode only the tiles of the rows and columns asked for, through a cache of recently decoded tiles shared by all
+    // readers (consecutive compositions mostly read the same tiles of the same frames, their ages are just one higher)
+    class CompressedDepthFrameStore : public DepthFrameStore {
+    public:
+        
+        //--------------------------------------------------------------
+        CompressedDepthFrameStore() {
+            tileWidth = 32;
+            tileHeight = 16;
+            numTilesX = numTilesY = 0;
+            chromaWidth = 0;
+            maxCacheBytes = 256 * 1024 * 1024;
+            maxCachedTiles = 0;
+            passTilesDecoded = passCacheHits = 0;
+            passDecodeMicros = 0;
+            lastTilesDecoded = lastCacheHits = 0;
+            lastDecodeMicros = 0;
+        }
+        
+        //--------------------------------------------------------------
+        // pixels per tile (height even, applied on the next allocate), smaller tiles decode less around what's read but compress worse
+        void setTileSize(int w, int h) {
+            tileWidth = max(8, w & ~1);
+            tileHeight = max(2, h & ~1);
+        }
+        
+        int getTileWidth() {
+            return tileWidth;
+        }
+        
+        int getTileHeight() {
+            return tileHeight;
+        }
+        
+        //--------------------------------------------------------------
+        // most memory for decoded tiles (applied on the next allocate)
+        void setCacheSize(size_t bytes) {
+            maxCacheBytes = bytes;
+        }
+        
+        size_t getCacheSize() {
+            return maxCacheBytes;
+        }
+        
+        //--------------------------------------------------------------
+        bool allocate(int numSlots, int width, int height) {
+            ofScopedLock lock(mutex);
+            this->numSlots = numSlots;
+            this->width = width;
+            this->height = height;
+            numTilesX = (width + tileWidth - 1) / tileWidth;
+            numTilesY = (height + tileHeight - 1) / tileHeight;
+            chromaWidth = (width + 1) / 2;
+            
+            // the old frames and their cached tiles go first, so they aren't held while the new ones are made
+            release();
+            cache.clear();
+            cacheIndex.clear();
+            lru.clear();
+            freeEntries.clear();
+            try {
+                depthData.resize(numSlots);
+                tileOffsets.assign((size_t)numSlots * (getNumTiles() + 1), 0);
+                vector<unsigned char>((size_t)numSlots * getLumaSize()).swap(luma);
+                vector<unsigned char>((size_t)numSlots * getChromaSize()).swap(chroma);
+            } catch(std::bad_alloc &) {
+                ofLog(OF_LOG_ERROR, "CompressedDepthFrameStore: can't allocate " + ofToString(numSlots) + " frames of " + ofToString(width) + "x" + ofToString(height));
+                release();
+                this->numSlots = 0;
+                return false;
+            }
+            
+            size_t tileBytes = (size_t)tileWidth * tileHeight * (sizeof(unsigned short) + 3);
+            maxCachedTiles = max((size_t)1, maxCacheBytes / tileBytes);
+            return true;
+        }
+        
+        //--------------------------------------------------------------
+        bool write(int slot, const DepthFrame &frame) {
+            // depth, every tile predicted on its own so it decodes without its neighbours
+            encoded.clear();
+            unsigned int *offsets = &tileOffsets[(size_t)slot * (getNumTiles() + 1)];
+            for(int ty=0, t=0; ty<numTilesY; ty++) {
+                for(int tx=0; tx<numTilesX; tx++, t++) {
+                    offsets[t] = encoded.size();
+                    int x = tx * tileWidth, y = ty * tileHeight;
+                    DepthCodec::encode(&frame.depth[(size_t)y * width + x], min(tileWidth, width - x), min(tileHeight, height - y), width, encoded);
+                }
+            }
+            offsets[getNumTiles()] = encoded.size();
+            
+            // keep the slot's buffer unless it's far bigger than needed, so noisy frames don't pin memory forever
+            vector<unsigned char> &data = depthData[slot];
+            if(data.capacity() > encoded.size() * 2) vector<unsigned char>(encoded).swap(data);
+            else data.assign(encoded.begin(), encoded.end());
+            
+            encodeColor(&frame.rgb[0], &luma[(size_t)slot * getLumaSize()], &chroma[(size_t)slot * getChromaSize()]);
+            
+            // tiles decoded from the frame this one replaces
+            ofScopedLock lock(mutex);
+            for(int t=0; t<getNumTiles(); t++) {
+                map<int, int>::iterator it = cacheIndex.find(slot * getNumTiles() + t);
+                if(it == cacheIndex.end()) continue;
+                lru.erase(cache[it->second].lruPos);
+                cache[it->second].key = -1;
+                freeEntries.push_back(it->second);
+                cacheIndex.erase(it);
+            }
+            return true;
+        }
+        
+        //--------------------------------------------------------------
+        void read(int slot, int rowBegin, int rowEnd, int columnBegin, int columnEnd, DepthRows &rows) {
+            int tyBegin = rowBegin / tileHeight;
+            int tyEnd = (rowEnd + tileHeight - 1) / tileHeight;
+            int txBegin = columnBegin / tileWidth;
+            int txEnd = (columnEnd + tileWidth - 1) / tileWidth;
+            int firstRow = tyBegin * tileHeight;
+            size_t numPixels = (size_t)(min(tyEnd * tileHeight, height) - firstRow) * width;
+            if(rows.depthBuffer.size() < numPixels) rows.depthBuffer.resize(numPixels);
+            if(rows.rgbBuffer.size() < numPixels * 3) rows.rgbBuffer.resize(numPixels * 3);
+            
+            for(int ty=tyBegin; ty<tyEnd; ty++) {
+                for(int tx=txBegin; tx<txEnd; tx++) {
+                    size_t pixel = (size_t)(ty * tileHeight - firstRow) * width + tx * tileWidth;
+                    readTile(slot, tx, ty, &rows.depthBuffer[pixel], &rows.rgbBuffer[pixel * 3]);
+                }
+            }
+            rows.depth = &rows.depthBuffer[(size_t)(rowBegin - firstRow) * width];
+            rows.rgb = &rows.rgbBuffer[(size_t)(rowBegin - firstRow) * width * 3];
+        }
+        
+        //--------------------------------------------------------------
+        // the reads of one composition start, the counters of the previous one become the last ones
+        void beginReads() {
+            ofScopedLock lock(mutex);
+            lastTilesDecoded = passTilesDecoded;
+            lastCacheHits = passCacheHits;
+            lastDecodeMicros = passDecodeMicros;
+            passTilesDecoded = passCacheHits = 0;
+            passDecodeMicros = 0;
+        }
+        
+        //--------------------------------------------------------------
+        size_t getBytesReserved() {
+            return getBytesCompressed() + getCacheBytes();
+        }
+        
+        //--------------------------------------------------------------
+        // memory held by the compressed frames
+        size_t getBytesCompressed() {
+            ofScopedLock lock(mutex);
+            size_t bytes = luma.capacity() + chroma.capacity() + tileOffsets.capacity() * sizeof(unsigned int);
+            for(int s=0; s<depthData.size(); s++) bytes += depthData[s].capacity();
+            return bytes;
+        }
+        
+        //--------------------------------------------------------------
+        // memory held by decoded tiles
+        size_t getCacheBytes() {
+            ofScopedLock lock(mutex);
+            size_t bytes = 0;
+            for(int i=0; i<cache.size(); i++) bytes += cache[i].depth.capacity() * sizeof(unsigned short) + cache[i].rgb.capacity();
+            return bytes;
+        }
+        
+        //--------------------------------------------------------------
+        // tiles decoded, tiles found in the cache and microseconds spent decoding (summed over all readers) by the last composition
+        int getNumTilesDecoded() {
+            ofScopedLock lock(mutex);
+            return lastTilesDecoded;
+        }
+        
+        int getNumCacheHits() {
+            ofScopedLock lock(mutex);
+            return lastCacheHits;
+        }
+        
+        unsigned long long getDecodeMicros() {
+            ofScopedLock lock(mutex);
+            return lastDecodeMicros;
+        }
+    
+    protected:
+        struct CachedTile {
+            int key;                    // slot * numTiles + tile, -1 if free
+            list<int>::iterator lruPos;
+            vector<unsigned short> depth;
+            vector<unsigned char> rgb;
+        };
+        
+        int tileWidth, tileHeight;
+        int numTilesX, numTilesY;
+        int chromaWidth;
+        vector< vector<unsigned char> > depthData;  // per slot, encoded tiles one after the other (row by row)
+        vector<unsigned int> tileOffsets;           // per slot numTiles + 1 offsets into its depthData
+        vector<unsigned char> luma;                 // per slot width x height
+        vector<unsigned char> chroma;               // per slot (width / 2) x (height / 2) pairs of Cb, Cr
+        vector<unsigned char> encoded;              // scratch for write
+        
+        ofMutex mutex;
+        size_t maxCacheBytes;
+        size_t maxCachedTiles;
+        vector<CachedTile> cache;
+        map<int, int> cacheIndex;       // key -> cache entry
+        list<int> lru;                  // cache entries, most recently used first
+        vector<int> freeEntries;
+        int passTilesDecoded, passCacheHits;
+        unsigned long long passDecodeMicros;
+        int lastTilesDecoded, lastCacheHits;
+        unsigned long long lastDecodeMicros;
+        
+        //--------------------------------------------------------------
+        int getNumTiles() {
+            return numTilesX * numTilesY;
+        }
+        
+        size_t getLumaSize() {
+            return (size_t)width * height;
+        }
+        
+        size_t getChromaSize() {
+            return (size_t)chromaWidth * ((height + 1) / 2) * 2;
+        }
+        
+        //--------------------------------------------------------------
+        // free the storage of all slots
+        void release() {
+            vector< vector<unsigned char> >().swap(depthData);
+            vector<unsigned int>().swap(tileOffsets);
+            vector<unsigned char>().swap(luma);
+            vector<unsigned char>().swap(chroma);
+        }
+        
+        //--------------------------------------------------------------
+        // decoded depth and rgb of tile (tx, ty) of slot into images of width pixels per row, from the cache or decoded (and cached)
+        void readTile(int slot, int tx, int ty, unsigned short *depth, unsigned char *rgb) {
+            int t = ty * numTilesX + tx;
+            int key = slot * getNumTiles() + t;
+            int x = tx * tileWidth, y = ty * tileHeight;
+            int w = min(tileWidth, width - x);
+            int h = min(tileHeight, height - y);
+            
+            mutex.lock();
+            map<int, int>::iterator it = cacheIndex.find(key);
+            if(it != cacheIndex.end()) {
+                CachedTile &entry = cache[it->second];
+                for(int j=0; j<h; j++) {
+                    memcpy(depth + j * width, &entry.depth[j * w], w * sizeof(unsigned short));
+                    memcpy(rgb + j * width * 3, &entry.rgb[j * w * 3], w * 3);
+                }
+                lru.splice(lru.begin(), lru, entry.lruPos);
+                passCacheHits++;
+                mutex.unlock();
+                return;
+            }
+            mutex.unlock();
+            
+            // decode outside the lock, slots aren't written while they're read
+            unsigned long long start = ofGetElapsedTimeMicros();
+            const unsigned int *offsets = &tileOffsets[(size_t)slot * (getNumTiles() + 1)];
+            const vector<unsigned char> &data = depthData[slot];
+            if(data.empty() || !DepthCodec::decode(&data[offsets[t]], offsets[t + 1] - offsets[t], w, h, width, depth)) {
+                for(int j=0; j<h; j++) memset(depth + j * width, 0, w * sizeof(unsigned short));
+            }
+            decodeColor(&luma[(size_t)slot * getLumaSize()], &chroma[(size_t)slot * getChromaSize()], x, y, w, h, rgb);
+            unsigned long long micros = ofGetElapsedTimeMicros() - start;
+            
+            ofScopedLock lock(mutex);
+            passTilesDecoded++;
+            passDecodeMicros += micros;
+            if(cacheIndex.count(key)) return;   // another reader decoded it meanwhile
+            int e = getFreeEntry();
+            CachedTile &entry = cache[e];
+            entry.key = key;
+            entry.depth.resize(w * h);
+            entry.rgb.resize(w * h * 3);
+            for(int j=0; j<h; j++) {
+                memcpy(&entry.depth[j * w], depth + j * width, w * sizeof(unsigned short));
+                memcpy(&entry.rgb[j * w * 3], rgb + j * width * 3, w * 3);
+            }
+            cacheIndex[key] = e;
+            lru.push_front(e);
+            entry.lruPos = lru.begin();
+        }
+        
+        //--------------------------------------------------------------
+        // a cache entry to fill, evicting the least recently used when full (call with mutex locked)
+        int getFreeEntry() {
+            if(!freeEntries.empty()) {
+                int e = freeEntries.back();
+                freeEntries.pop_back();
+                return e;
+            }
+            if(cache.size() < maxCachedTiles) {
+                cache.push_back(CachedTile());
+                return cache.size() - 1;
+            }
+            int e = lru.back();
+            lru.pop_back();
+            cacheIndex.erase(cache[e].key);
+            return e;
+        }
+        
+        //--------------------------------------------------------------
+        // rgb to full range YCbCr (as in JPEG), chroma averaged over 2 x 2 pixels
+        void encodeColor(const unsigned char *rgb, unsigned char *outLuma, unsigned char *outChroma) {
+            for(int j=0; j<height; j += 2) {
+                for(int i=0; i<width; i += 2) {
+                    int r = 0, g = 0, b = 0, n = 0;
+                    for(int y=j; y<min(j + 2, height); y++) {
+                        for(int x=i; x<min(i + 2, width); x++, n++) {
+                            const unsigned char *c = rgb + ((size_t)y * width + x) * 3;
+                            outLuma[(size_t)y * width + x] = (77 * c[0] + 150 * c[1] + 29 * c[2] + 128) >> 8;
+                            r += c[0];
+                            g += c[1];
+                            b += c[2];
+                        }
+                    }
+                    r /= n;
+                    g /= n;
+                    b /= n;
+                    unsigned char *cbcr = outChroma + ((size_t)(j / 2) * chromaWidth + i / 2) * 2;
+                    cbcr[0] = clampByte(((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128);
+                    cbcr[1] = clampByte(((128 * r - 107 * g - 21 * b + 128) >> 8) + 128);
+                }
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // rgb of the w x h pixels from (x, y) (both even) of a frame's luma and chroma, into an image of width pixels per row
+        void decodeColor(const unsigned char *frameLuma, const unsigned char *frameChroma, int x, int y, int w, int h, unsigned char *rgb) {
+            for(int j=0; j<h; j++) {
+                const unsigned char *l = frameLuma + (size_t)(y + j) * width + x;
+                const unsigned char *cbcr = frameChroma + ((size_t)((y + j) / 2) * chromaWidth + x / 2) * 2;
+                unsigned char *out = rgb + (size_t)j * width * 3;
+                for(int i=0; i<w; i += 2, cbcr += 2, out += 6) {
+                    // both pixels of a pair share their chroma
+                    int cb = cbcr[0] - 128;
+                    int cr = cbcr[1] - 128;
+                    int r = 359 * cr + 128;
+                    int g = -88 * cb - 183 * cr + 128;
+                    int b = 454 * cb + 128;
+                    int v = l[i] << 8;
+                    out[0] = clampByte((v + r) >> 8);
+                    out[1] = clampByte((v + g) >> 8);
+                    out[2] = clampByte((v + b) >> 8);
+                    if(i + 1 == w) break;
+                    v = l[i + 1] << 8;
+                    out[3] = clampByte((v + r) >> 8);
+                    out[4] = clampByte((v + g) >> 8);
+                    out[5] = clampByte((v + b) >> 8);
+                }
+            }
+        }
+        
+        //--------------------------------------------------------------
+        static unsigned char clampByte(int v) {
+            return v < 0 ? 0 : (v > 255 ? 255 : v);
+        }
+    };
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "ofMain.h"
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // lossless compression of 16 bit depth images, no dependencies
+    // each pixel is predicted from its left neighbour (the first pixel of a row from the one above),
+    // the residuals are zigzag encoded into varints and runs of zero residuals are run length encoded:
+    // token (v << 1) is a residual v, token (n << 1) | 1 is a run of n + 2 zero residuals
+    // noisy surfaces cost about a byte per pixel, smooth surfaces and holes much less
+    class DepthCodec {
+    public:
+        
+        //--------------------------------------------------------------
+        // append the encoded image to out
+        static void encode(const unsigned short *depth, int width, int height, vector<unsigned char> &out) {
+            encode(depth, width, height, width, out);
+        }
+        
+        //--------------------------------------------------------------
+        // encode a width x height part of a larger image with stride values per row
+        static void encode(const unsigned short *depth, int width, int height, int stride, vector<unsigned char> &out) {
+            out.reserve(out.size() + width * height);
+            for(int j=0; j<height; j++) {
+                const unsigned short *row = depth + j * stride;
+                int zeros = 0;
+                for(int i=0; i<width; i++) {
+                    int pred = i > 0 ? row[i - 1] : (j > 0 ? row[i - stride] : 0);
+                    int residual = row[i] - pred;
+                    if(residual == 0) {
+                        zeros++;
+                        continue;
+                    }
+                    flushZeros(zeros, out);
+                    putVarint(zigzag(residual) << 1, out);
+                }
+                flushZeros(zeros, out);
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // decode a width x height image from size bytes of data into depth, returns false if the data is corrupt
+        static bool decode(const unsigned char *data, size_t size, int width, int height, unsigned short *depth) {
+            return decode(data, size, width, height, width, depth);
+        }
+        
+        //--------------------------------------------------------------
+        // decode into a width x height part of a larger image with stride values per row
+        static bool decode(const unsigned char *data, size_t size, int width, int height, int stride, unsigned short *depth) {
+            const unsigned char *end = data + size;
+            for(int j=0; j<height; j++) {
+                unsigned short *row = depth + j * stride;
+                unsigned short pred = j > 0 ? row[-stride] : 0;    // the first pixel of a row is predicted from the one above
+                int i = 0;
+                while(i < width) {
+                    unsigned int token;
+                    if(data < end && *data < 0x80) token = *data++;  // most tokens are a single byte
+                    else if(!getVarint(data, end, token)) return false;
+                    if(token & 1) {
+                        // run of zero residuals, i.e. repeats of the prediction
+                        int n = (token >> 1) + 2;
+                        if(i + n > width) return false;
+                        for(int k=0; k<n; k++, i++) row[i] = pred;
+                    } else {
+                        pred += unzigzag(token >> 1);
+                        row[i++] = pred;
+                    }
+                }
+            }
+            return data == end;
+        }
+        
+        //--------------------------------------------------------------
+        // little endian varint (7 bits per byte, high bit set on all but the last byte)
+        static void putVarint(unsigned int v, vector<unsigned char> &out) {
+            while(v >= 0x80) {
+                out.push_back((v & 0x7f) | 0x80);
+                v >>= 7;
+            }
+            out.push_back(v);
+        }
+        
+        //--------------------------------------------------------------
+        static bool getVarint(const unsigned char *&data, const unsigned char *end, unsigned int &v) {
+            v = 0;
+            for(int shift=0; shift<35; shift += 7) {
+                if(data == end) return false;
+                unsigned char b = *data++;
+                v |= (unsigned int)(b & 0x7f) << shift;
+                if((b & 0x80) == 0) return true;
+            }
+            return false;
+        }
+        
+        //--------------------------------------------------------------
+        // map signed to unsigned so small magnitudes stay small: 0, -1, 1, -2, 2... -> 0, 1, 2, 3, 4...
+        static unsigned int zigzag(int v) {
+            return (v << 1) ^ (v >> 31);
+        }
+        
+        static int unzigzag(unsigned int v) {
+            return (v >> 1) ^ -(int)(v & 1);
+        }
+    
+    protected:
+        //--------------------------------------------------------------
+        static void flushZeros(int &zeros, vector<unsigned char> &out) {
+            if(zeros == 1) putVarint(0, out);
+            else if(zeros > 1) putVarint(((zeros - 2) << 1) | 1, out);
+            zeros = 0;
+        }
+    };
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "ofMain.h"
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // one captured depth + color image
+    class DepthFrame {
+    public:
+        
+        //--------------------------------------------------------------
+        DepthFrame() {
+            width = 0;
+            height = 0;
+            timestamp = 0;
+            frameNum = 0;
+        }
+        
+        //--------------------------------------------------------------
+        // copy images into this frame (depth can be NULL for sources without depth, e.g. webcam)
+        void setFromPixels(const unsigned short *depthPixels, const unsigned char *rgbPixels, int width, int height) {
+            this->width = width;
+            this->height = height;
+            if(depthPixels) depth.assign(depthPixels, depthPixels + width * height);
+            else depth.clear();
+            rgb.assign(rgbPixels, rgbPixels + width * height * 3);
+        }
+        
+        //--------------------------------------------------------------
+        bool hasDepth() const {
+            return !depth.empty();
+        }
+        
+        //--------------------------------------------------------------
+        // exchange contents with other frame without copying the images
+        void swap(DepthFrame &other) {
+            std::swap(width, other.width);
+            std::swap(height, other.height);
+            std::swap(timestamp, other.timestamp);
+            std::swap(frameNum, other.frameNum);
+            depth.swap(other.depth);
+            rgb.swap(other.rgb);
+        }
+        
+        int width, height;
+        vector<unsigned short> depth;   // millimetres, 0 for no reading, empty if the source has no depth
+        vector<unsigned char> rgb;      // width * height * 3
+        unsigned long long timestamp;   // capture time in microseconds
+        int frameNum;                   // capture frame number
+    };
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "ofMain.h"
+#include "MSADepthFrame.h"
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // rows of a stored frame handed out by DepthFrameStore::read
+    // each reader (thread) keeps its own, so stores which decode frames have somewhere to decode into
+    struct DepthRows {
+        const unsigned short *depth;        // width values per row, starting at the first row read
+        const unsigned char *rgb;           // width * 3 values per row
+        vector<unsigned short> depthBuffer; // storage for stores which don't keep frames as plain images
+        vector<unsigned char> rgbBuffer;
+        
+        DepthRows() {
+            depth = NULL;
+            rgb = NULL;
+        }
+    };
+
+
+
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // keeps the depth and color images of a fixed number of equally sized frames in numbered slots
+    // frames are written whole (from the compose stage) and read a range of rows at a time (from any number of threads)
+    class DepthFrameStore {
+    public:
+        
+        //--------------------------------------------------------------
+        DepthFrameStore() {
+            numSlots = 0;
+            width = 0;
+            height = 0;
+        }
+        
+        virtual ~DepthFrameStore() {}
+        
+        //--------------------------------------------------------------
+        // make room for numSlots frames of width x height (discards all frames), returns false on failure
+        virtual bool allocate(int numSlots, int width, int height) = 0;
+        
+        //--------------------------------------------------------------
+        // store the images of frame (width x height, with depth) in slot, returns false on failure (the slot is then undefined)
+        virtual bool write(int slot, const DepthFrame &frame) = 0;
+        
+        //--------------------------------------------------------------
+        // point rows at rows [rowBegin, rowEnd) of slot's images, valid until rows is read into again
+        // only columns [columnBegin, columnEnd) of them have to be filled in
+        virtual void read(int slot, int rowBegin, int rowEnd, int columnBegin, int columnEnd, DepthRows &rows) = 0;
+        
+        //--------------------------------------------------------------
+        // called before the reads of each composition (e.g. to count per composition)
+        virtual void beginReads() {}
+        
+        //--------------------------------------------------------------
+        // hint that rows [rowBegin, rowEnd) of slot will be read soon
+        virtual void prefetch(int slot, int rowBegin, int rowEnd) {}
+        
+        //--------------------------------------------------------------
+        // bytes held in memory for all slots
+        virtual size_t getBytesReserved() = 0;
+        
+        //--------------------------------------------------------------
+        int getNumSlots() {
+            return numSlots;
+        }
+        
+        int getWidth() {
+            return width;
+        }
+        
+        int getHeight() {
+            return height;
+        }
+    
+    protected:
+        int numSlots;
+        int width, height;
+    };
+
+
+
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // stores frames as they are: 5 bytes per pixel (e.g. 1.5 MB per 640x480 frame), reads are free
+    class MemoryDepthFrameStore : public DepthFrameStore {
+    public:
+        
+        //--------------------------------------------------------------
+        bool allocate(int numSlots, int width, int height) {
+            this->numSlots = numSlots;
+            this->width = width;
+            this->height = height;
+            size_t numPixels = (size_t)numSlots * width * height;
+            if(depth.size() != numPixels) {
+                // exactly the memory asked for, so the history's footprint is what its size says
+                // the old images go first, so they aren't held while the new ones are made
+                vector<unsigned short>().swap(depth);
+                vector<unsigned char>().swap(rgb);
+                try {
+                    vector<unsigned short>(numPixels).swap(depth);
+                    vector<unsigned char>(numPixels * 3).swap(rgb);
+                } catch(std::bad_alloc &) {
+                    ofLog(OF_LOG_ERROR, "MemoryDepthFrameStore: can't allocate " + ofToString(numPixels * 5 / (1024 * 1024)) + " MB for " + ofToString(numSlots) + " frames");
+                    vector<unsigned short>().swap(depth);
+                    vector<unsigned char>().swap(rgb);
+                    this->numSlots = 0;
+                    return false;
+                }
+            }
+            return true;
+        }
+        
+        //--------------------------------------------------------------
+        bool write(int slot, const DepthFrame &frame) {
+            size_t numPixels = (size_t)width * height;
+            memcpy(&depth[slot * numPixels], &frame.depth[0], numPixels * sizeof(unsigned short));
+            memcpy(&rgb[slot * numPixels * 3], &frame.rgb[0], numPixels * 3);
+            return true;
+        }
+        
+        //--------------------------------------------------------------
+        void read(int slot, int rowBegin, int rowEnd, int columnBegin, int columnEnd, DepthRows &rows) {
+            size_t pixel = (size_t)slot * width * height + (size_t)rowBegin * width;
+            rows.depth = &depth[pixel];
+            rows.rgb = &rgb[pixel * 3];
+        }
+        
+        //--------------------------------------------------------------
+        size_t getBytesReserved() {
+            return depth.capacity() * sizeof(unsigned short) + rgb.capacity();
+        }
+    
+    protected:
+        vector<unsigned short> depth;
+        vector<unsigned char> rgb;
+    };
+}
@@ -0,0 +1,420 @@
+#pragma once
+
+#include "ofMain.h"
+#include "MSASpaceTime.h"
+#include "MSADepthFrameStore.h"
+#include "MSADepthToWorld.h"
+#include "MSAThreadPool.h"
+#include <climits>
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // history of raw depth + color frames, an alternative to a SpaceTime of binned PointSpaces
+    // adding a frame is a copy into a DepthFrameStore slot, and the pixels are only converted to world positions and cells
+    // when composing, for the frames and image regions the gradient pulls cells from:
+    // the cells of each age bound a box in world space, which the ray table bounds to a rectangle of pixels
+    // so memory per frame is fixed, and thresholds, boundaries and cells can change without invalidating the history
+    class DepthHistory : protected ParallelJob {
+    public:
+        
+        //--------------------------------------------------------------
+        // conversion of stored frames while composing
+        struct Settings {
+            float nearThreshold, farThreshold;
+            int pixelStep;
+            ofVec3f boundaryMin, boundaryMax;
+            ofVec3f numCells;
+        };
+        
+        //--------------------------------------------------------------
+        DepthHistory() {
+            store = &memoryStore;
+            storeFailed = false;
+            maxFrames = 0;
+            numFrames = 0;
+            head = 0;
+            width = 0;
+            height = 0;
+            numChunks = 0;
+            phase = 0;
+            cellAges = NULL;
+            rays = NULL;
+            rayBoundsWidth = 0;
+            rayBoundsHeight = 0;
+            numRowsRead = 0;
+        }
+        
+        //--------------------------------------------------------------
+        // keep frames in store (NULL for plain images in memory), clears the history
+        void setStore(DepthFrameStore *store) {
+            this->store = store ? store : &memoryStore;
+            storeFailed = false;
+            clear();
+            width = height = 0;
+        }
+        
+        //--------------------------------------------------------------
+        DepthFrameStore& getStore() {
+            return *store;
+        }
+        
+        //--------------------------------------------------------------
+        // set maximum number of frames, clears the history if it changed (the store has a fixed number of slots)
+        void setMaxFrames(int m) {
+            if(m == maxFrames) return;
+            maxFrames = m;
+            storeFailed = false;
+            clear();
+            width = height = 0;     // reallocate on the next frame
+        }
+        
+        //--------------------------------------------------------------
+        int getMaxFrames() {
+            return maxFrames;
+        }
+        
+        //--------------------------------------------------------------
+        // true if the store couldn't allocate or write frames (the history stays empty until the store or number of frames changes)
+        bool getStoreFailed() {
+            return storeFailed;
+        }
+        
+        //--------------------------------------------------------------
+        int getNumFrames() {
+            return numFrames;
+        }
+        
+        //--------------------------------------------------------------
+        // forget all frames (keeps the store's memory)
+        void clear() {
+            numFrames = 0;
+            head = 0;
+            frameNums.assign(maxFrames, 0);
+            depthMin.assign(maxFrames, 0);
+            depthMax.assign(maxFrames, 0);
+        }
+        
+        //--------------------------------------------------------------
+        // copy frame (with depth) into the history as the most recent frame, evicting the oldest if full
+        // a frame of a different size clears the history
+        void addFrame(const DepthFrame &frame) {
+            if(maxFrames == 0 || !frame.hasDepth() || storeFailed) return;
+            if(frame.width != width || frame.height != height) {
+                if(!store->allocate(maxFrames, frame.width, frame.height)) {
+                    // don't try again every frame, until the store or number of frames changes
+                    ofLog(OF_LOG_ERROR, "DepthHistory: can't allocate " + ofToString(maxFrames) + " frames");
+                    storeFailed = true;
+                    return;
+                }
+                width = frame.width;
+                height = frame.height;
+                clear();
+            }
+            if(!store->write(head, frame)) {
+                // the slot now holds whatever part of the frame made it, so don't compose from the store at all
+                ofLog(OF_LOG_ERROR, "DepthHistory: can't store frame " + ofToString(frame.frameNum) + ", history stopped");
+                storeFailed = true;
+                clear();
+                return;
+            }
+            frameNums[head] = frame.frameNum;
+            
+            // depths the frame holds, the nearer they are the wider pixel rects their cells cover
+            unsigned short dMin = USHRT_MAX, dMax = 0;
+            int numPixels = width * height;
+            for(int n=0; n<numPixels; n++) {
+                unsigned short d = frame.depth[n];
+                if(d == 0) continue;
+                dMin = min(dMin, d);
+                dMax = max(dMax, d);
+            }
+            depthMin[head] = dMin;
+            depthMax[head] = dMax;
+            head = (head + 1) % maxFrames;
+            if(numFrames < maxFrames) numFrames++;
+        }
+        
+        //--------------------------------------------------------------
+        // capture frame number of the frame at given age (0 is most recent)
+        int getFrameNum(int age) {
+            return frameNums[getSlot(age)];
+        }
+        
+        //--------------------------------------------------------------
+        // bytes held by the store
+        size_t getBytesReserved() {
+            return store->getBytesReserved();
+        }
+        
+        //--------------------------------------------------------------
+        // image rows converted by the last compose (out of numFrames * height in the worst case)
+        int getNumRowsRead() {
+            return numRowsRead;
+        }
+        
+        //--------------------------------------------------------------
+        // compose the points of every cell (of a grid with settings.numCells in settings' boundaries) from the frame
+        // of its age in cellAges (as from TemporalGradient::getCellAges for getNumFrames frames), converting through rays
+        void compose(const int *cellAges, const Settings &settings, DepthToWorld &rays, vector<ofVec3f> &outVertices, vector<ofFloatColor> &outColors, ThreadPool *pool = NULL) {
+            outVertices.clear();
+            outColors.clear();
+            numRowsRead = 0;
+            if(numFrames == 0 || cellAges == NULL || rays.getWidth() != width || rays.getHeight() != height) return;
+            
+            this->cellAges = cellAges;
+            this->settings = settings;
+            this->rays = &rays;
+            grid.setNumCells(settings.numCells);
+            grid.setBoundaries(settings.boundaryMin, settings.boundaryMax);
+            updateRayBounds(rays);
+            findAgeRegions();
+            if(ages.empty()) return;
+            
+            numChunks = min((int)ages.size(), pool ? pool->getNumThreads() * 4 : 1);
+            if(chunks.size() < numChunks) chunks.resize(numChunks);
+            
+            // pass 1: every chunk converts the regions of its ages and keeps the points in cells of those ages
+            store->beginReads();
+            run(0, pool);
+            
+            unsigned int numPoints = 0;
+            for(int c=0; c<numChunks; c++) {
+                chunks[c].outOffset = numPoints;
+                numPoints += chunks[c].vertices.size();
+                numRowsRead += chunks[c].numRowsRead;
+            }
+            outVertices.resize(numPoints);
+            outColors.resize(numPoints);
+            this->outVertices = numPoints > 0 ? &outVertices[0] : NULL;
+            this->outColors = numPoints > 0 ? &outColors[0] : NULL;
+            
+            // pass 2: copy chunks into the output
+            if(numPoints > 0) run(1, pool);
+            
+            // the next composition (after the next frame) reads about the same regions, from frames one older
+            for(int r=0; r<ages.size(); r++) {
+                if(ages[r].age > 0) store->prefetch(getSlot(ages[r].age - 1), ages[r].jBegin, ages[r].jEnd);
+            }
+        }
+    
+    protected:
+        // pixels of one age which can hold points in cells of that age
+        struct AgeRegion {
+            int age;
+            int iBegin, iEnd;       // columns
+            int jBegin, jEnd;       // rows
+            float zMin, zMax;       // depths (within the thresholds)
+            
+            bool operator<(const AgeRegion &other) const {
+                // largest first, so chunks taking every numChunks-th region get about the same work
+                int area = (iEnd - iBegin) * (jEnd - jBegin);
+                int otherArea = (other.iEnd - other.iBegin) * (other.jEnd - other.jBegin);
+                return area != otherArea ? area > otherArea : age < other.age;
+            }
+        };
+        
+        // per task points and scratch space
+        struct Chunk {
+            vector<ofVec3f> vertices;
+            vector<ofFloatColor> colors;
+            DepthRows rows;
+            vector<float> x, y, z;
+            vector<unsigned char> valid;
+            vector<ofVec3f> positions;      // valid pixels of a row inside the region
+            vector<int> pixels;             // and their columns
+            vector<unsigned int> cells;
+            unsigned int outOffset;
+            int numRowsRead;
+        };
+        
+        MemoryDepthFrameStore memoryStore;
+        DepthFrameStore *store;
+        bool storeFailed;           // couldn't allocate or write, no frames are added until the store or number of frames changes
+        int maxFrames;
+        int numFrames;
+        int head;                   // slot the next frame goes into
+        int width, height;          // of the frames in the store
+        vector<int> frameNums;      // per slot
+        vector<unsigned short> depthMin, depthMax;  // per slot, nearest and farthest depth > 0 (min > max if there's none)
+        
+        // compose
+        const int *cellAges;
+        Settings settings;
+        DepthToWorld *rays;
+        SpaceGrid grid;
+        vector<int> ageBoxes;               // per age: min and max quantum index on each axis
+        vector<AgeRegion> ages;
+        vector<float> columnRayMin, columnRayMax;   // range of ray x in each column
+        vector<float> rowRayMin, rowRayMax;         // range of ray y in each row
+        int rayBoundsWidth, rayBoundsHeight;
+        vector<Chunk> chunks;
+        int numChunks;
+        int phase;
+        int numRowsRead;
+        ofVec3f *outVertices;
+        ofFloatColor *outColors;
+        
+        //--------------------------------------------------------------
+        // slot of frame at given age (0 is most recent)
+        int getSlot(int age) {
+            return (head - 1 - age + maxFrames) % maxFrames;
+        }
+        
+        //--------------------------------------------------------------
+        // ray ranges per column and row, rebuilt when the ray table changes size
+        void updateRayBounds(DepthToWorld &rays) {
+            if(rayBoundsWidth == width && rayBoundsHeight == height) return;
+            rayBoundsWidth = width;
+            rayBoundsHeight = height;
+            columnRayMin.assign(width, FLT_MAX);
+            columnRayMax.assign(width, -FLT_MAX);
+            rowRayMin.assign(height, FLT_MAX);
+            rowRayMax.assign(height, -FLT_MAX);
+            const float *rx = rays.getRaysX();
+            const float *ry = rays.getRaysY();
+            for(int j=0; j<height; j++) {
+                for(int i=0; i<width; i++) {
+                    int p = j * width + i;
+                    columnRayMin[i] = min(columnRayMin[i], rx[p]);
+                    columnRayMax[i] = max(columnRayMax[i], rx[p]);
+                    rowRayMin[j] = min(rowRayMin[j], ry[p]);
+                    rowRayMax[j] = max(rowRayMax[j], ry[p]);
+                }
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // bound the cells of every age by a box of quantum indices, and the box by a rectangle of pixels
+        void findAgeRegions() {
+            int nx = max(1, (int)settings.numCells.x);
+            int ny = max(1, (int)settings.numCells.y);
+            int nz = max(1, (int)settings.numCells.z);
+            ageBoxes.resize(numFrames * 6);
+            for(int a=0; a<numFrames; a++) {
+                int *box = &ageBoxes[a * 6];
+                box[0] = box[2] = box[4] = INT_MAX;
+                box[1] = box[3] = box[5] = -1;
+            }
+            for(int k=0, c=0; k<nz; k++) {
+                for(int j=0; j<ny; j++) {
+                    for(int i=0; i<nx; i++, c++) {
+                        int *box = &ageBoxes[cellAges[c] * 6];
+                        box[0] = min(box[0], i);
+                        box[1] = max(box[1], i);
+                        box[2] = min(box[2], j);
+                        box[3] = max(box[3], j);
+                        box[4] = min(box[4], k);
+                        box[5] = max(box[5], k);
+                    }
+                }
+            }
+            
+            ages.clear();
+            for(int a=0; a<numFrames; a++) {
+                int *box = &ageBoxes[a * 6];
+                if(box[1] < 0) continue;
+                
+                // world box, with a millimetre of slack against rounding (pixels are tested exactly later)
+                float xMin, xMax, yMin, yMax, zMin, zMax;
+                grid.getAxisRange(0, box[0], box[1], xMin, xMax);
+                grid.getAxisRange(1, box[2], box[3], yMin, yMax);
+                grid.getAxisRange(2, box[4], box[5], zMin, zMax);
+                AgeRegion region;
+                region.age = a;
+                int slot = getSlot(a);
+                region.zMin = max(max(zMin - 1, settings.nearThreshold), (float)depthMin[slot]);
+                region.zMax = min(min(zMax + 1, settings.farThreshold), (float)depthMax[slot]);
+                if(region.zMax < region.zMin || region.zMax <= 0) continue;
+                zMin = max(region.zMin, 0.0f);
+                zMax = region.zMax;
+                findRange(columnRayMin, columnRayMax, xMin - 1, xMax + 1, zMin, zMax, region.iBegin, region.iEnd);
+                findRange(rowRayMin, rowRayMax, yMin - 1, yMax + 1, zMin, zMax, region.jBegin, region.jEnd);
+                if(region.iBegin < region.iEnd && region.jBegin < region.jEnd) ages.push_back(region);
+            }
+            std::sort(ages.begin(), ages.end());
+        }
+        
+        //--------------------------------------------------------------
+        // first and one past last index whose ray range times [zMin, zMax] meets [pMin, pMax] (empty if none)
+        static void findRange(const vector<float> &rayMin, const vector<float> &rayMax, float pMin, float pMax, float zMin, float zMax, int &begin, int &end) {
+            begin = 0;
+            end = 0;
+            for(int n=0; n<rayMin.size(); n++) {
+                // rays times depths span the products of their extremes
+                float lo = min(min(rayMin[n] * zMin, rayMin[n] * zMax), min(rayMax[n] * zMin, rayMax[n] * zMax));
+                float hi = max(max(rayMin[n] * zMin, rayMin[n] * zMax), max(rayMax[n] * zMin, rayMax[n] * zMax));
+                if(hi < pMin || lo > pMax) continue;
+                if(end == 0) begin = n;
+                end = n + 1;
+            }
+        }
+        
+        //--------------------------------------------------------------
+        void run(int phase, ThreadPool *pool) {
+            this->phase = phase;
+            if(pool) pool->run(*this, numChunks);
+            else for(int c=0; c<numChunks; c++) runTask(c);
+        }
+        
+        //--------------------------------------------------------------
+        void runTask(int c) {
+            Chunk &chunk = chunks[c];
+            if(phase == 0) {
+                chunk.vertices.clear();
+                chunk.colors.clear();
+                chunk.numRowsRead = 0;
+                for(int r=c; r<ages.size(); r += numChunks) convertRegion(ages[r], chunk);
+            } else {
+                int n = chunk.vertices.size();
+                if(n == 0) return;
+                memcpy(outVertices + chunk.outOffset, &chunk.vertices[0], n * sizeof(ofVec3f));
+                memcpy(outColors + chunk.outOffset, &chunk.colors[0], n * sizeof(ofFloatColor));
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // convert the pixels of region and keep the ones in cells of its age
+        void convertRegion(const AgeRegion &region, Chunk &chunk) {
+            int step = settings.pixelStep;
+            int jBegin = (region.jBegin + step - 1) / step * step;     // stay on the pixelStep grid
+            int iBegin = (region.iBegin + step - 1) / step * step;
+            if(jBegin >= region.jEnd || iBegin >= region.iEnd) return;
+            
+            int rowSize = (width + step - 1) / step;
+            chunk.x.resize(rowSize);
+            chunk.y.resize(rowSize);
+            chunk.z.resize(rowSize);
+            chunk.valid.resize(rowSize);
+            
+            store->read(getSlot(region.age), jBegin, region.jEnd, iBegin, region.iEnd, chunk.rows);
+            for(int j=jBegin; j<region.jEnd; j += step) {
+                const unsigned short *depthRow = chunk.rows.depth + (j - jBegin) * width;
+                const unsigned char *rgbRow = chunk.rows.rgb + (j - jBegin) * width * 3;
+                chunk.numRowsRead++;
+                if(rays->convertRowRange(j, depthRow, iBegin, region.iEnd, step, region.zMin, region.zMax, &chunk.x[0], &chunk.y[0], &chunk.z[0], &chunk.valid[0]) == 0) continue;
+                
+                chunk.positions.clear();
+                chunk.pixels.clear();
+                for(int i=iBegin, o=0; i<region.iEnd; i += step, o++) {
+                    if(!chunk.valid[o]) continue;
+                    chunk.positions.push_back(ofVec3f(chunk.x[o], chunk.y[o], chunk.z[o]));
+                    chunk.pixels.push_back(i);
+                }
+                int numPositions = chunk.positions.size();
+                if(numPositions == 0) continue;
+                
+                chunk.cells.resize(numPositions);
+                grid.cellIndicesForPositions(&chunk.positions[0], &chunk.cells[0], numPositions);
+                for(int n=0; n<numPositions; n++) {
+                    if(cellAges[chunk.cells[n]] != region.age) continue;
+                    const unsigned char *c = rgbRow + chunk.pixels[n] * 3;
+                    chunk.vertices.push_back(chunk.positions[n]);
+                    chunk.colors.push_back(ofFloatColor(c[0] / 255.0f, c[1] / 255.0f, c[2] / 255.0f));
+                }
+            }
+        }
+    };
+}
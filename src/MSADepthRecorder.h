@@ -0,0 +1,600 @@
+#pragma once
+
+#include "ofMain.h"
+#include "MSADepthSource.h"
+#include "MSADepthFrame.h"
+#include "MSADepthToWorld.h"
+#include "MSADepthCodec.h"
+#include "MSAFrameQueue.h"
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // depth recording file format (all little endian):
+    //   header:  "MSADEPTH" u32 version, u32 width, u32 height, f32 rays x[width * height], f32 rays y[width * height]
+    //   frames:  "FRAM" u32 chunk size (after this field), u64 timestamp (microseconds), i32 frame number,
+    //            u32 depth size, depth (DepthCodec), u32 rgb size, rgb (raw, 0 bytes if none)
+    //   index:   "INDX" u32 chunk size, u32 number of frames, { u64 file offset, u64 timestamp } per frame
+    //   trailer: u64 file offset of the index, "MSAINDEX"
+    // a file without index (e.g. the recorder crashed) is still readable, the frames are scanned on load
+    namespace DepthRecording {
+        static const unsigned int version = 1;
+        static const int headerSize = 8 + 3 * 4;
+        static const int trailerSize = 8 + 8;
+        
+        //--------------------------------------------------------------
+        inline void putU32(unsigned int v, vector<unsigned char> &out) {
+            for(int i=0; i<4; i++) out.push_back(v >> (i * 8));
+        }
+        
+        inline void putU64(unsigned long long v, vector<unsigned char> &out) {
+            for(int i=0; i<8; i++) out.push_back(v >> (i * 8));
+        }
+        
+        inline void putF32(float f, vector<unsigned char> &out) {
+            unsigned int v;
+            memcpy(&v, &f, 4);
+            putU32(v, out);
+        }
+        
+        inline void putTag(const char *tag, vector<unsigned char> &out) {
+            out.insert(out.end(), tag, tag + strlen(tag));
+        }
+        
+        //--------------------------------------------------------------
+        inline unsigned int getU32(const unsigned char *p) {
+            return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+        }
+        
+        inline unsigned long long getU64(const unsigned char *p) {
+            return getU32(p) | ((unsigned long long)getU32(p + 4) << 32);
+        }
+        
+        inline float getF32(const unsigned char *p) {
+            unsigned int v = getU32(p);
+            float f;
+            memcpy(&f, &v, 4);
+            return f;
+        }
+        
+        //--------------------------------------------------------------
+        // 64 bit file positions (recordings easily grow beyond 2GB)
+        inline bool seek(FILE *file, unsigned long long offset, int origin = SEEK_SET) {
+#ifdef TARGET_WIN32
+            return _fseeki64(file, offset, origin) == 0;
+#else
+            return fseeko(file, offset, origin) == 0;
+#endif
+        }
+        
+        inline unsigned long long tell(FILE *file) {
+#ifdef TARGET_WIN32
+            return _ftelli64(file);
+#else
+            return ftello(file);
+#endif
+        }
+        
+        //--------------------------------------------------------------
+        inline bool read(FILE *file, vector<unsigned char> &buffer, size_t size) {
+            buffer.resize(size);
+            return size == 0 || fread(&buffer[0], 1, size, file) == size;
+        }
+    }
+
+
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // records DepthFrames to a file on its own thread
+    // addFrame copies the frame into a queue, so it can be called from the capture or ingest side without waiting on the disk
+    class DepthRecorder : public ofThread {
+    public:
+        
+        //--------------------------------------------------------------
+        DepthRecorder() {
+            file = NULL;
+            numFramesWritten = 0;
+            bytesWritten = 0;
+            queue.setDropPolicy(FRAME_DROP_NEWEST);
+        }
+        
+        //--------------------------------------------------------------
+        ~DepthRecorder() {
+            stop();
+        }
+        
+        //--------------------------------------------------------------
+        // start recording width x height frames to path (relative to data folder), rays are stored to convert the depth on playback
+        // up to queueCapacity frames wait for the disk before new frames are dropped
+        bool start(string path, DepthToWorld &rays, int queueCapacity = 32) {
+            using namespace DepthRecording;
+            stop();
+            
+            file = fopen(ofToDataPath(path).c_str(), "wb");
+            if(file == NULL) {
+                ofLog(OF_LOG_ERROR, "DepthRecorder::start: can't open " + path);
+                return false;
+            }
+            
+            width = rays.getWidth();
+            height = rays.getHeight();
+            vector<unsigned char> header;
+            putTag("MSADEPTH", header);
+            putU32(version, header);
+            putU32(width, header);
+            putU32(height, header);
+            for(int i=0; i<width * height; i++) putF32(rays.getRaysX()[i], header);
+            for(int i=0; i<width * height; i++) putF32(rays.getRaysY()[i], header);
+            fwrite(&header[0], 1, header.size(), file);
+            
+            this->path = path;
+            index.clear();
+            numFramesWritten = 0;
+            bytesWritten = header.size();
+            queue.setCapacity(queueCapacity);
+            startThread(false, false);
+            ofLog(OF_LOG_NOTICE, "DepthRecorder::start: recording to " + path);
+            return true;
+        }
+        
+        //--------------------------------------------------------------
+        // write the remaining queued frames and the index, and close the file
+        void stop() {
+            if(file == NULL) return;
+            queue.close();
+            waitForThread(true);
+            
+            using namespace DepthRecording;
+            unsigned long long indexOffset = tell(file);
+            vector<unsigned char> chunk;
+            putTag("INDX", chunk);
+            putU32(4 + index.size() * 16, chunk);
+            putU32(index.size(), chunk);
+            for(int i=0; i<index.size(); i++) {
+                putU64(index[i].offset, chunk);
+                putU64(index[i].timestamp, chunk);
+            }
+            putU64(indexOffset, chunk);
+            putTag("MSAINDEX", chunk);
+            fwrite(&chunk[0], 1, chunk.size(), file);
+            fclose(file);
+            file = NULL;
+            ofLog(OF_LOG_NOTICE, "DepthRecorder::stop: " + ofToString(index.size()) + " frames in " + path);
+        }
+        
+        //--------------------------------------------------------------
+        bool isRecording() {
+            return file != NULL;
+        }
+        
+        //--------------------------------------------------------------
+        // queue a copy of frame for writing, returns false if it was dropped (or not recording)
+        // frames must be the size given to start
+        bool addFrame(const DepthFrame &frame) {
+            if(file == NULL || frame.width != width || frame.height != height) return false;
+            pending.width = frame.width;
+            pending.height = frame.height;
+            pending.depth = frame.depth;
+            pending.rgb = frame.rgb;
+            pending.timestamp = frame.timestamp;
+            pending.frameNum = frame.frameNum;
+            return queue.push(pending);
+        }
+        
+        //--------------------------------------------------------------
+        int getNumFramesWritten() {
+            return __sync_fetch_and_add(&numFramesWritten, 0);
+        }
+        
+        unsigned long getNumFramesDropped() {
+            return queue.getNumDropped();
+        }
+        
+        unsigned long long getBytesWritten() {
+            return __sync_fetch_and_add(&bytesWritten, 0);
+        }
+    
+    protected:
+        struct IndexEntry {
+            unsigned long long offset;
+            unsigned long long timestamp;
+        };
+        
+        FILE *file;
+        string path;
+        int width, height;
+        FrameQueue<DepthFrame> queue;
+        DepthFrame pending;                 // only touched by the caller of addFrame
+        vector<IndexEntry> index;           // only touched by the writer thread until it's joined
+        volatile int numFramesWritten;
+        volatile unsigned long long bytesWritten;
+        
+        //--------------------------------------------------------------
+        void threadedFunction() {
+            DepthFrame frame;
+            vector<unsigned char> chunk;
+            while(queue.waitPop(frame)) write(frame, chunk);
+            while(queue.pop(frame)) write(frame, chunk);        // closed, write what's left
+        }
+        
+        //--------------------------------------------------------------
+        void write(const DepthFrame &frame, vector<unsigned char> &chunk) {
+            using namespace DepthRecording;
+            chunk.clear();
+            putTag("FRAM", chunk);
+            putU32(0, chunk);   // chunk size, filled in below
+            putU64(frame.timestamp, chunk);
+            putU32(frame.frameNum, chunk);
+            
+            size_t sizePos = chunk.size();
+            putU32(0, chunk);
+            if(frame.hasDepth()) DepthCodec::encode(&frame.depth[0], frame.width, frame.height, chunk);
+            unsigned int depthSize = chunk.size() - sizePos - 4;
+            for(int i=0; i<4; i++) chunk[sizePos + i] = depthSize >> (i * 8);
+            
+            putU32(frame.rgb.size(), chunk);
+            chunk.insert(chunk.end(), frame.rgb.begin(), frame.rgb.end());
+            
+            unsigned int chunkSize = chunk.size() - 8;
+            for(int i=0; i<4; i++) chunk[4 + i] = chunkSize >> (i * 8);
+            
+            IndexEntry entry;
+            entry.offset = tell(file);
+            entry.timestamp = frame.timestamp;
+            if(fwrite(&chunk[0], 1, chunk.size(), file) != chunk.size()) {
+                ofLog(OF_LOG_ERROR, "DepthRecorder: write failed, disk full?");
+                return;
+            }
+            index.push_back(entry);
+            __sync_fetch_and_add(&numFramesWritten, 1);
+            __sync_fetch_and_add(&bytesWritten, chunk.size());
+        }
+    };
+
+
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // plays back a recording made with DepthRecorder as a DepthSource
+    class DepthPlayer : public DepthSource {
+    public:
+        
+        //--------------------------------------------------------------
+        DepthPlayer() {
+            file = NULL;
+            fileSize = 0;
+            width = 0;
+            height = 0;
+            realtime = true;
+            loop = true;
+            frameIndex = -1;
+            recordedFrameNum = -1;
+            bNewFrame = false;
+            bFinished = false;
+            bTextureDirty = false;
+            startMicros = 0;
+        }
+        
+        //--------------------------------------------------------------
+        ~DepthPlayer() {
+            close();
+        }
+        
+        //--------------------------------------------------------------
+        // open a recording (path relative to data folder) and decode its first frame
+        bool load(string path) {
+            using namespace DepthRecording;
+            close();
+            file = fopen(ofToDataPath(path).c_str(), "rb");
+            if(file == NULL) {
+                ofLog(OF_LOG_ERROR, "DepthPlayer::load: can't open " + path);
+                return false;
+            }
+            
+            fileSize = seek(file, 0, SEEK_END) ? tell(file) : 0;
+            vector<unsigned char> buffer;
+            if(!seek(file, 0) || !read(file, buffer, headerSize) || memcmp(&buffer[0], "MSADEPTH", 8) != 0 || getU32(&buffer[8]) > version) {
+                ofLog(OF_LOG_ERROR, "DepthPlayer::load: " + path + " is not a depth recording");
+                close();
+                return false;
+            }
+            unsigned int headerWidth = getU32(&buffer[12]);
+            unsigned int headerHeight = getU32(&buffer[16]);
+            if(headerWidth == 0 || headerHeight == 0 || (unsigned long long)headerWidth * headerHeight * 8 > fileSize - headerSize) {
+                ofLog(OF_LOG_ERROR, "DepthPlayer::load: " + path + " is truncated or has a corrupt header");
+                close();
+                return false;
+            }
+            width = headerWidth;
+            height = headerHeight;
+            int numPixels = width * height;
+            if(!read(file, buffer, numPixels * 8)) {
+                ofLog(OF_LOG_ERROR, "DepthPlayer::load: " + path + " is truncated");
+                close();
+                return false;
+            }
+            raysX.resize(numPixels);
+            raysY.resize(numPixels);
+            for(int i=0; i<numPixels; i++) {
+                raysX[i] = getF32(&buffer[i * 4]);
+                raysY[i] = getF32(&buffer[(numPixels + i) * 4]);
+            }
+            unsigned long long firstFrameOffset = tell(file);
+            
+            if(!loadIndex()) scanIndex(firstFrameOffset);
+            ofLog(OF_LOG_NOTICE, "DepthPlayer::load: " + path + " " + ofToString(width) + "x" + ofToString(height) + ", " + ofToString(index.size()) + " frames");
+            
+            depth.assign(numPixels, 0);
+            pixels.allocate(width, height, 3);
+            bFinished = false;
+            if(index.empty()) return true;
+            setFrameIndex(0);
+            return true;
+        }
+        
+        //--------------------------------------------------------------
+        // realtime (default): update() moves to the frame recorded at the time elapsed since playback started
+        // otherwise every update() moves to the next frame, as fast as the caller asks
+        void setRealtime(bool b) {
+            realtime = b;
+            resetClock();
+        }
+        
+        //--------------------------------------------------------------
+        // start over at the end (default), otherwise stay on the last frame and report isFinished()
+        void setLoop(bool b) {
+            loop = b;
+        }
+        
+        //--------------------------------------------------------------
+        int getNumFrames() {
+            return index.size();
+        }
+        
+        //--------------------------------------------------------------
+        // index of the current frame in the recording (0...getNumFrames()-1)
+        int getFrameIndex() {
+            return frameIndex;
+        }
+        
+        //--------------------------------------------------------------
+        // jump to and decode frame i (realtime playback continues from there), returns false if it can't be read
+        bool setFrameIndex(int i) {
+            if(!showFrame(i)) return false;
+            resetClock();
+            return true;
+        }
+        
+        //--------------------------------------------------------------
+        // capture time (microseconds) and frame number of the current frame as recorded
+        unsigned long long getTimestamp() {
+            return frameIndex >= 0 ? index[frameIndex].timestamp : 0;
+        }
+        
+        int getRecordedFrameNum() {
+            return recordedFrameNum;
+        }
+        
+        //--------------------------------------------------------------
+        // true once the last frame has been reached when not looping
+        bool isFinished() {
+            return bFinished;
+        }
+        
+        //--------------------------------------------------------------
+        // ray tables as recorded, e.g. for DepthToWorld::setup
+        const vector<float>& getRaysX() {
+            return raysX;
+        }
+        
+        const vector<float>& getRaysY() {
+            return raysY;
+        }
+
+
+        //--------------------------------------------------------------
+        unsigned short* getRawDepthPixels() {
+            return depth.empty() ? NULL : &depth[0];
+        }
+        
+        //--------------------------------------------------------------
+        ofVec3f getWorldCoordinateAt(float x, float y, float z) {
+            int i = ofClamp(x, 0, width - 1);
+            int j = ofClamp(y, 0, height - 1);
+            return ofVec3f(raysX[j * width + i] * z, raysY[j * width + i] * z, z);
+        }
+        
+        //--------------------------------------------------------------
+        unsigned char* getPixels() {
+            return pixels.getPixels();
+        }
+        
+        ofPixels& getPixelsRef() {
+            return pixels;
+        }
+        
+        //--------------------------------------------------------------
+        void update() {
+            bNewFrame = false;
+            if(index.empty()) return;
+            
+            int last = index.size() - 1;
+            int next = frameIndex + 1;
+            if(realtime) {
+                // last frame recorded at or before the elapsed time, the last frame is held for one average frame interval
+                unsigned long long t = index[0].timestamp + ofGetElapsedTimeMicros() - startMicros;
+                unsigned long long interval = last > 0 ? (index[last].timestamp - index[0].timestamp) / last : 0;
+                next = t > index[last].timestamp + interval ? last + 1 : frameIndex;
+                while(next < last && index[next + 1].timestamp <= t) next++;
+            }
+            
+            if(next > last) {
+                // reached the end
+                if(loop) setFrameIndex(0);
+                else bFinished = true;
+            } else if(next != frameIndex) {
+                showFrame(next);
+            }
+        }
+        
+        bool isFrameNew() {
+            return bNewFrame;
+        }
+        
+        void close() {
+            if(file) fclose(file);
+            file = NULL;
+            fileSize = 0;
+            index.clear();
+            frameIndex = -1;
+            recordedFrameNum = -1;
+        }
+        
+        //--------------------------------------------------------------
+        void draw(float x, float y) {
+            draw(x, y, width, height);
+        }
+        
+        void draw(float x, float y, float w, float h) {
+            if(width == 0) return;
+            if(bTextureDirty) {
+                if(!texture.bAllocated()) texture.allocate(width, height, GL_RGB);
+                texture.loadData(pixels.getPixels(), width, height, GL_RGB);
+                bTextureDirty = false;
+            }
+            texture.draw(x, y, w, h);
+        }
+        
+        float getWidth() {
+            return width;
+        }
+        
+        float getHeight() {
+            return height;
+        }
+    
+    protected:
+        struct IndexEntry {
+            unsigned long long offset;
+            unsigned long long timestamp;
+        };
+        
+        FILE *file;
+        unsigned long long fileSize;
+        int width, height;
+        vector<float> raysX, raysY;
+        vector<IndexEntry> index;
+        bool realtime;
+        bool loop;
+        int frameIndex;
+        int recordedFrameNum;
+        bool bNewFrame;
+        bool bFinished;
+        unsigned long long startMicros;
+        
+        vector<unsigned short> depth;
+        ofPixels pixels;
+        ofTexture texture;
+        bool bTextureDirty;
+        vector<unsigned char> buffer;
+        
+        //--------------------------------------------------------------
+        void resetClock() {
+            unsigned long long elapsed = frameIndex >= 0 ? index[frameIndex].timestamp - index[0].timestamp : 0;
+            startMicros = ofGetElapsedTimeMicros() - elapsed;
+        }
+        
+        //--------------------------------------------------------------
+        bool showFrame(int i) {
+            if(i < 0 || i >= index.size()) return false;
+            frameIndex = i;
+            bNewFrame = true;
+            bTextureDirty = true;
+            return readFrame(index[i].offset);
+        }
+        
+        //--------------------------------------------------------------
+        // read the index written when the recording was stopped
+        bool loadIndex() {
+            using namespace DepthRecording;
+            if(fileSize < headerSize + trailerSize || !seek(file, fileSize - trailerSize)) return false;
+            if(!read(file, buffer, trailerSize) || memcmp(&buffer[8], "MSAINDEX", 8) != 0) return false;
+            
+            unsigned long long indexOffset = getU64(&buffer[0]);
+            if(indexOffset > fileSize - trailerSize - 12) return false;
+            if(!seek(file, indexOffset) || !read(file, buffer, 12) || memcmp(&buffer[0], "INDX", 4) != 0) return false;
+            unsigned int numFrames = getU32(&buffer[8]);
+            if(numFrames > (fileSize - trailerSize - indexOffset - 12) / 16) return false;     // corrupt, more than fits in the file
+            if(!read(file, buffer, (size_t)numFrames * 16)) return false;
+            index.resize(numFrames);
+            for(int i=0; i<numFrames; i++) {
+                index[i].offset = getU64(&buffer[i * 16]);
+                index[i].timestamp = getU64(&buffer[i * 16 + 8]);
+            }
+            return true;
+        }
+        
+        //--------------------------------------------------------------
+        // rebuild the index by walking the frame chunks (for recordings that weren't stopped properly)
+        void scanIndex(unsigned long long offset) {
+            using namespace DepthRecording;
+            ofLog(OF_LOG_WARNING, "DepthPlayer: no index, scanning frames");
+            index.clear();
+            while(seek(file, offset) && read(file, buffer, 16) && memcmp(&buffer[0], "FRAM", 4) == 0) {
+                IndexEntry entry;
+                entry.offset = offset;
+                entry.timestamp = getU64(&buffer[8]);
+                offset += 8 + getU32(&buffer[4]);
+                // only keep complete frames
+                if(!seek(file, offset - 1) || fgetc(file) == EOF) break;
+                index.push_back(entry);
+            }
+        }
+        
+        //--------------------------------------------------------------
+        bool readFrame(unsigned long long offset) {
+            using namespace DepthRecording;
+            if(!seek(file, offset) || !read(file, buffer, 8) || memcmp(&buffer[0], "FRAM", 4) != 0) return false;
+            
+            // sizes are checked against what was read before they're used, the chunk may be partly written or corrupt
+            unsigned long long chunkSize = getU32(&buffer[4]);
+            if(chunkSize < 20 || chunkSize > fileSize - offset - 8 || !read(file, buffer, chunkSize)) {
+                ofLog(OF_LOG_ERROR, "DepthPlayer: truncated frame " + ofToString(frameIndex));
+                return false;
+            }
+            
+            recordedFrameNum = getU32(&buffer[8]);
+            const unsigned char *p = &buffer[12];
+            unsigned int depthSize = getU32(p);
+            p += 4;
+            if(16 + (unsigned long long)depthSize + 4 > chunkSize) {
+                ofLog(OF_LOG_ERROR, "DepthPlayer: corrupt depth size in frame " + ofToString(frameIndex));
+                return false;
+            }
+            unsigned int rgbSize = getU32(p + depthSize);
+            if(16 + (unsigned long long)depthSize + 4 + rgbSize > chunkSize) {
+                ofLog(OF_LOG_ERROR, "DepthPlayer: corrupt rgb size in frame " + ofToString(frameIndex));
+                return false;
+            }
+            
+            if(depthSize == 0) std::fill(depth.begin(), depth.end(), 0);
+            else if(!DepthCodec::decode(p, depthSize, width, height, &depth[0])) {
+                ofLog(OF_LOG_ERROR, "DepthPlayer: corrupt depth in frame " + ofToString(frameIndex));
+                return false;
+            }
+            p += depthSize + 4;
+            
+            // frames recorded without color are black rather than keeping the previous frame's colors
+            if(rgbSize == 0) memset(pixels.getPixels(), 0, (size_t)width * height * 3);
+            else if(rgbSize == (unsigned long long)width * height * 3) memcpy(pixels.getPixels(), p, rgbSize);
+            else {
+                ofLog(OF_LOG_ERROR, "DepthPlayer: corrupt rgb in frame " + ofToString(frameIndex));
+                return false;
+            }
+            return true;
+        }
+    };
+}
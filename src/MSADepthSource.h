@@ -0,0 +1,23 @@
+#pragma once
+
+#include "ofMain.h"
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // a video source with registered depth (e.g. kinect, synthetic scenes, recordings)
+    // getPixels() is the rgb image, getRawDepthPixels() the depth image in millimetres (0 for no reading)
+    class DepthSource : public ofBaseVideo, public ofBaseDraws {
+    public:
+        virtual ~DepthSource() {}
+        
+        //--------------------------------------------------------------
+        virtual unsigned short* getRawDepthPixels() = 0;
+        
+        //--------------------------------------------------------------
+        // world position (millimetres) of image position (x, y) at depth z
+        virtual ofVec3f getWorldCoordinateAt(float x, float y, float z) = 0;
+    };
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "ofMain.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // converts raw depth images (millimetres) to world positions a row at a time
+    // world position of pixel (i, j) at depth z is (rayX * z, rayY * z, z), with the rays precomputed per pixel
+    // uses AVX2 or SSE2 when the compiler targets them, otherwise (and for pixel steps > 1) plain scalar code
+    class DepthToWorld {
+    public:
+        
+        //--------------------------------------------------------------
+        DepthToWorld() {
+            width = 0;
+            height = 0;
+        }
+        
+        //--------------------------------------------------------------
+        // build the ray table from any camera with getWorldCoordinateAt(x, y, z) (e.g. ofxKinect)
+        template <typename Camera>
+        void setup(Camera &camera, int width, int height) {
+            allocate(width, height);
+            for(int j=0; j<height; j++) {
+                for(int i=0; i<width; i++) {
+                    ofVec3f ray = camera.getWorldCoordinateAt(i, j, 1.0f);
+                    raysX[j * width + i] = ray.x;
+                    raysY[j * width + i] = ray.y;
+                }
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // allocate an (uninitialized) ray table, fill it with getRaysX / getRaysY
+        void allocate(int width, int height) {
+            this->width = width;
+            this->height = height;
+            raysX.resize(width * height);
+            raysY.resize(width * height);
+        }
+        
+        //--------------------------------------------------------------
+        int getWidth() {
+            return width;
+        }
+        
+        //--------------------------------------------------------------
+        int getHeight() {
+            return height;
+        }
+        
+        //--------------------------------------------------------------
+        float* getRaysX() {
+            return raysX.empty() ? NULL : &raysX[0];
+        }
+        
+        //--------------------------------------------------------------
+        float* getRaysY() {
+            return raysY.empty() ? NULL : &raysY[0];
+        }
+        
+        //--------------------------------------------------------------
+        // convert every step-th pixel of row j of a depth image
+        // writes (width + step - 1) / step positions to outX, outY, outZ and 1 / 0 to outValid for pixels
+        // with depth > 0 and nearThreshold <= depth <= farThreshold, returns the number of valid pixels
+        int convertRow(int j, const unsigned short *depthRow, int step, float nearThreshold, float farThreshold, float *outX, float *outY, float *outZ, unsigned char *outValid) {
+            return convertRowRange(j, depthRow, 0, width, step, nearThreshold, farThreshold, outX, outY, outZ, outValid);
+        }
+        
+        //--------------------------------------------------------------
+        // convertRow for pixels [iBegin, iEnd) of row j only (iBegin a multiple of step), the first goes to outX[0] etc.
+        int convertRowRange(int j, const unsigned short *depthRow, int iBegin, int iEnd, int step, float nearThreshold, float farThreshold, float *outX, float *outY, float *outZ, unsigned char *outValid) {
+            if(step != 1) return convertRowScalar(j, depthRow, iBegin, iEnd, step, nearThreshold, farThreshold, outX, outY, outZ, outValid);
+            
+            const float *rx = &raysX[j * width + iBegin];
+            const float *ry = &raysY[j * width + iBegin];
+            depthRow += iBegin;
+            int n = iEnd - iBegin;
+            int numValid = 0;
+            int i = 0;
+            
+#if defined(__AVX2__)
+            __m256 zero = _mm256_setzero_ps();
+            __m256 nearV = _mm256_set1_ps(nearThreshold);
+            __m256 farV = _mm256_set1_ps(farThreshold);
+            for(; i + 8 <= n; i += 8) {
+                __m256 z = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(depthRow + i))));
+                _mm256_storeu_ps(outX + i, _mm256_mul_ps(_mm256_loadu_ps(rx + i), z));
+                _mm256_storeu_ps(outY + i, _mm256_mul_ps(_mm256_loadu_ps(ry + i), z));
+                _mm256_storeu_ps(outZ + i, z);
+                __m256 valid = _mm256_and_ps(_mm256_cmp_ps(z, zero, _CMP_GT_OQ), _mm256_and_ps(_mm256_cmp_ps(z, nearV, _CMP_GE_OQ), _mm256_cmp_ps(z, farV, _CMP_LE_OQ)));
+                numValid += storeMask(_mm256_movemask_ps(valid), 8, outValid + i);
+            }
+#elif defined(__SSE2__)
+            __m128i zeroi = _mm_setzero_si128();
+            __m128 zero = _mm_setzero_ps();
+            __m128 nearV = _mm_set1_ps(nearThreshold);
+            __m128 farV = _mm_set1_ps(farThreshold);
+            for(; i + 8 <= n; i += 8) {
+                __m128i d = _mm_loadu_si128((const __m128i*)(depthRow + i));
+                __m128 zs[2] = { _mm_cvtepi32_ps(_mm_unpacklo_epi16(d, zeroi)), _mm_cvtepi32_ps(_mm_unpackhi_epi16(d, zeroi)) };
+                for(int h=0; h<2; h++) {
+                    int o = i + h * 4;
+                    __m128 z = zs[h];
+                    _mm_storeu_ps(outX + o, _mm_mul_ps(_mm_loadu_ps(rx + o), z));
+                    _mm_storeu_ps(outY + o, _mm_mul_ps(_mm_loadu_ps(ry + o), z));
+                    _mm_storeu_ps(outZ + o, z);
+                    __m128 valid = _mm_and_ps(_mm_cmpgt_ps(z, zero), _mm_and_ps(_mm_cmpge_ps(z, nearV), _mm_cmple_ps(z, farV)));
+                    numValid += storeMask(_mm_movemask_ps(valid), 4, outValid + o);
+                }
+            }
+#endif
+            
+            // remaining pixels
+            for(; i<n; i++) {
+                numValid += convertPixel(depthRow[i], rx[i], ry[i], nearThreshold, farThreshold, outX[i], outY[i], outZ[i], outValid[i]);
+            }
+            return numValid;
+        }
+        
+        //--------------------------------------------------------------
+        // reference implementation of convertRow
+        int convertRowScalar(int j, const unsigned short *depthRow, int step, float nearThreshold, float farThreshold, float *outX, float *outY, float *outZ, unsigned char *outValid) {
+            return convertRowScalar(j, depthRow, 0, width, step, nearThreshold, farThreshold, outX, outY, outZ, outValid);
+        }
+        
+        int convertRowScalar(int j, const unsigned short *depthRow, int iBegin, int iEnd, int step, float nearThreshold, float farThreshold, float *outX, float *outY, float *outZ, unsigned char *outValid) {
+            const float *rx = &raysX[j * width];
+            const float *ry = &raysY[j * width];
+            int numValid = 0;
+            for(int i=iBegin, o=0; i<iEnd; i += step, o++) {
+                numValid += convertPixel(depthRow[i], rx[i], ry[i], nearThreshold, farThreshold, outX[o], outY[o], outZ[o], outValid[o]);
+            }
+            return numValid;
+        }
+        
+    protected:
+        int width, height;
+        vector<float> raysX, raysY;
+        
+        //--------------------------------------------------------------
+        int convertPixel(unsigned short depth, float rx, float ry, float nearThreshold, float farThreshold, float &x, float &y, float &z, unsigned char &valid) {
+            z = depth;
+            x = rx * z;
+            y = ry * z;
+            valid = z > 0 && z >= nearThreshold && z <= farThreshold;
+            return valid;
+        }
+        
+        //--------------------------------------------------------------
+        int storeMask(int mask, int n, unsigned char *outValid) {
+            int numValid = 0;
+            for(int b=0; b<n; b++) {
+                outValid[b] = (mask >> b) & 1;
+                numValid += outValid[b];
+            }
+            return numValid;
+        }
+    };
+}
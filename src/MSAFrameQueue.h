@@ -0,0 +1,207 @@
+#pragma once
+
+#include "ofMain.h"
+#include "Poco/Event.h"
+
+namespace msa {
+    
+    // what FrameQueue::push() does when the queue is full
+    enum FrameDropPolicy {
+        FRAME_DROP_OLDEST,  // discard the oldest queued item to make room
+        FRAME_DROP_NEWEST,  // discard the item being pushed
+        FRAME_BLOCK         // wait for the consumer to make room
+    };
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // bounded lock-free queue handing frames from one producer thread to one consumer thread
+    // items are swapped in and out of preallocated slots (T needs a swap()), so buffers are recycled rather than copied
+    // each slot carries a sequence number saying whether it is free for the producer or ready for the consumer (after Vyukov)
+    template <typename T>
+    class FrameQueue {
+    public:
+        
+        //--------------------------------------------------------------
+        FrameQueue() {
+            policy = FRAME_DROP_OLDEST;
+            setCapacity(4);
+        }
+        
+        //--------------------------------------------------------------
+        // set number of slots (rounded up to a power of two), empties and reopens the queue and resets the counters
+        // not thread safe, only call while neither side is running
+        void setCapacity(int n) {
+            unsigned int capacity = 1;
+            while(capacity < n) capacity <<= 1;
+            mask = capacity - 1;
+            slots.clear();
+            slots.resize(capacity);
+            for(unsigned int i=0; i<capacity; i++) slots[i].sequence = i;
+            enqueuePos = 0;
+            dequeuePos = 0;
+            closed = false;
+            numEnqueued = 0;
+            numDropped = 0;
+            highWaterMark = 0;
+            dataEvent.reset();
+            spaceEvent.reset();
+        }
+        
+        //--------------------------------------------------------------
+        int getCapacity() const {
+            return mask + 1;
+        }
+        
+        //--------------------------------------------------------------
+        // producer side
+        void setDropPolicy(FrameDropPolicy p) {
+            policy = p;
+        }
+        
+        //--------------------------------------------------------------
+        FrameDropPolicy getDropPolicy() const {
+            return policy;
+        }
+        
+        //--------------------------------------------------------------
+        // producer: swap item into the queue (item gets back a recycled buffer)
+        // returns false if the item was dropped because the queue was full (or closed)
+        bool push(T &item) {
+            while(!isClosed()) {
+                if(tryPush(item)) return true;
+                
+                switch(policy) {
+                    case FRAME_DROP_OLDEST:
+                        // make room by consuming the oldest item ourselves
+                        if(tryPop(dropped)) __sync_fetch_and_add(&numDropped, 1);
+                        if(tryPush(item)) return true;
+                        
+                        // the consumer is still swapping out of the slot we need, drop this one rather than wait
+                        __sync_fetch_and_add(&numDropped, 1);
+                        return false;
+                    
+                    case FRAME_DROP_NEWEST:
+                        __sync_fetch_and_add(&numDropped, 1);
+                        return false;
+                    
+                    case FRAME_BLOCK:
+                        spaceEvent.wait();
+                        break;
+                }
+            }
+            __sync_fetch_and_add(&numDropped, 1);
+            return false;
+        }
+        
+        //--------------------------------------------------------------
+        // consumer: swap the oldest item out of the queue into item, returns false if the queue is empty
+        bool pop(T &item) {
+            if(!tryPop(item)) return false;
+            spaceEvent.set();
+            return true;
+        }
+        
+        //--------------------------------------------------------------
+        // consumer: like pop() but waits for an item, returns false once the queue is closed
+        bool waitPop(T &item) {
+            while(!isClosed()) {
+                if(pop(item)) return true;
+                dataEvent.wait();
+            }
+            return false;
+        }
+        
+        //--------------------------------------------------------------
+        // wake up and release both sides, push() drops everything from now on
+        void close() {
+            __sync_lock_test_and_set(&closed, 1);
+            dataEvent.set();
+            spaceEvent.set();
+        }
+        
+        //--------------------------------------------------------------
+        bool isClosed() {
+            return __sync_fetch_and_add(&closed, 0) != 0;
+        }
+        
+        //--------------------------------------------------------------
+        // number of items currently queued (approximate while either side is running)
+        int getSize() {
+            return __sync_fetch_and_add(&enqueuePos, 0) - __sync_fetch_and_add(&dequeuePos, 0);
+        }
+        
+        //--------------------------------------------------------------
+        // number of items successfully pushed
+        unsigned long getNumEnqueued() {
+            return __sync_fetch_and_add(&numEnqueued, 0);
+        }
+        
+        //--------------------------------------------------------------
+        // number of items discarded, either pushed to a full queue or pushed out of it
+        unsigned long getNumDropped() {
+            return __sync_fetch_and_add(&numDropped, 0);
+        }
+        
+        //--------------------------------------------------------------
+        // most items that have been queued at once
+        int getHighWaterMark() {
+            return __sync_fetch_and_add(&highWaterMark, 0);
+        }
+    
+    protected:
+        struct Slot {
+            volatile unsigned int sequence;     // == position when free for the producer, position+1 when ready for the consumer
+            T item;
+        };
+        
+        vector<Slot> slots;
+        unsigned int mask;
+        volatile unsigned int enqueuePos;       // only advanced by the producer
+        volatile unsigned int dequeuePos;       // advanced by the consumer, or the producer when dropping the oldest
+        volatile int closed;
+        FrameDropPolicy policy;
+        T dropped;                              // receives items pushed out of the queue, only touched by the producer
+        
+        volatile unsigned long numEnqueued;
+        volatile unsigned long numDropped;
+        volatile int highWaterMark;
+        
+        Poco::Event dataEvent;                  // set when an item is pushed
+        Poco::Event spaceEvent;                 // set when an item is popped
+        
+        //--------------------------------------------------------------
+        bool tryPush(T &item) {
+            unsigned int pos = enqueuePos;
+            Slot &slot = slots[pos & mask];
+            if(__sync_fetch_and_add(&slot.sequence, 0) != pos) return false;   // full, or consumer still swapping out of this slot
+            
+            slot.item.swap(item);
+            __sync_fetch_and_add(&slot.sequence, 1);       // full barrier, publishes the item to the consumer
+            __sync_fetch_and_add(&enqueuePos, 1);
+            
+            __sync_fetch_and_add(&numEnqueued, 1);
+            int size = getSize();
+            if(size > highWaterMark) __sync_lock_test_and_set(&highWaterMark, size);
+            dataEvent.set();
+            return true;
+        }
+        
+        //--------------------------------------------------------------
+        bool tryPop(T &item) {
+            unsigned int pos = __sync_fetch_and_add(&dequeuePos, 0);
+            Slot *slot;
+            while(true) {
+                slot = &slots[pos & mask];
+                int diff = (int)(__sync_fetch_and_add(&slot->sequence, 0) - (pos + 1));
+                if(diff < 0) return false;      // empty
+                if(diff == 0 && __sync_bool_compare_and_swap(&dequeuePos, pos, pos + 1)) break;
+                pos = __sync_fetch_and_add(&dequeuePos, 0);
+            }
+            
+            slot->item.swap(item);
+            __sync_fetch_and_add(&slot->sequence, mask);    // pos + 1 -> pos + capacity, hands the slot back to the producer
+            return true;
+        }
+    };
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxKinect.h"
+#include "MSADepthSource.h"
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // DepthSource reading from an (already opened) ofxKinect
+    class KinectDepthSource : public DepthSource {
+    public:
+        
+        //--------------------------------------------------------------
+        KinectDepthSource() {
+            kinect = NULL;
+        }
+        
+        //--------------------------------------------------------------
+        void setup(ofxKinect &kinect) {
+            this->kinect = &kinect;
+        }
+        
+        //--------------------------------------------------------------
+        unsigned short* getRawDepthPixels() {
+            return kinect->getRawDepthPixels();
+        }
+        
+        ofVec3f getWorldCoordinateAt(float x, float y, float z) {
+            return kinect->getWorldCoordinateAt(x, y, z);
+        }
+        
+        //--------------------------------------------------------------
+        unsigned char* getPixels() {
+            return kinect->getPixels();
+        }
+        
+        ofPixels& getPixelsRef() {
+            return kinect->getPixelsRef();
+        }
+        
+        //--------------------------------------------------------------
+        void update() {
+            kinect->update();
+        }
+        
+        bool isFrameNew() {
+            return kinect->isFrameNew();
+        }
+        
+        void close() {
+            kinect->close();
+        }
+        
+        //--------------------------------------------------------------
+        void draw(float x, float y) {
+            kinect->draw(x, y);
+        }
+        
+        void draw(float x, float y, float w, float h) {
+            kinect->draw(x, y, w, h);
+        }
+        
+        float getWidth() {
+            return kinect->getWidth();
+        }
+        
+        float getHeight() {
+            return kinect->getHeight();
+        }
+        
+    protected:
+        ofxKinect *kinect;
+    };
+}
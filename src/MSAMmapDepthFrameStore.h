@@ -0,0 +1,272 @@
+#pragma once
+
+#include "ofMain.h"
+#include "MSADepthFrameStore.h"
+#include <list>
+#ifndef TARGET_WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // stores frames as plain images in fixed size slots of a memory mapped file (on a local SSD), for histories of many minutes
+    // the page cache decides what stays in memory, with two hints: rows about to be read are read ahead (prefetch),
+    // and the least recently used slots are dropped from the process once more than maxResidentBytes of slots were touched
+    // the file is unlinked as soon as it's mapped, so it never outlives the process
+    // POSIX only (allocate fails on windows)
+    class MmapDepthFrameStore : public DepthFrameStore {
+    public:
+        
+        //--------------------------------------------------------------
+        MmapDepthFrameStore() {
+            path = "history.slots";
+            fd = -1;
+            data = NULL;
+            mappedBytes = 0;
+            slotBytes = 0;
+            maxResidentBytes = (size_t)1024 * 1024 * 1024;
+            numResident = 0;
+            numPrefetched = 0;
+            numEvicted = 0;
+        }
+        
+        ~MmapDepthFrameStore() {
+            unmap();
+        }
+        
+        //--------------------------------------------------------------
+        // file to map (relative to the data folder), applied on the next allocate
+        void setPath(string path) {
+            this->path = path;
+        }
+        
+        string getPath() {
+            return path;
+        }
+        
+        //--------------------------------------------------------------
+        // most bytes of slots kept mapped in before the least recently used are dropped (the process' share of the history)
+        void setMaxResidentBytes(size_t bytes) {
+            ofScopedLock lock(mutex);
+            maxResidentBytes = bytes;
+        }
+        
+        size_t getMaxResidentBytes() {
+            return maxResidentBytes;
+        }
+        
+        //--------------------------------------------------------------
+        bool allocate(int numSlots, int width, int height) {
+            unmap();
+#ifdef TARGET_WIN32
+            ofLog(OF_LOG_ERROR, "MmapDepthFrameStore: memory mapped history isn't supported on windows");
+            return false;
+#else
+            // slots on page boundaries, so dropping one never drops a neighbour
+            size_t pageSize = sysconf(_SC_PAGESIZE);
+            size_t frameBytes = (size_t)width * height * (sizeof(unsigned short) + 3);
+            size_t bytes = (frameBytes + pageSize - 1) / pageSize * pageSize * numSlots;
+            
+            string filePath = ofToDataPath(path);
+            fd = open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if(fd < 0) {
+                ofLog(OF_LOG_ERROR, "MmapDepthFrameStore: can't open " + filePath + ": " + strerror(errno));
+                return false;
+            }
+            unlink(filePath.c_str());
+            
+            // reserve the disk space now rather than leaving holes, so a disk too small fails here and not frames later
+#ifdef TARGET_OSX
+            fstore_t reserve = { F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)bytes, 0 };
+            int error = fcntl(fd, F_PREALLOCATE, &reserve) == -1 || ftruncate(fd, bytes) != 0 ? errno : 0;
+#else
+            int error = posix_fallocate(fd, 0, bytes);
+#endif
+            if(error != 0) {
+                ofLog(OF_LOG_ERROR, "MmapDepthFrameStore: can't make " + filePath + " " + ofToString(bytes / (1024 * 1024)) + " MB: " + strerror(error));
+                unmap();
+                return false;
+            }
+            void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if(p == MAP_FAILED) {
+                ofLog(OF_LOG_ERROR, "MmapDepthFrameStore: can't map " + filePath + ": " + strerror(errno));
+                unmap();
+                return false;
+            }
+            
+            // reads jump between frames, only read ahead what's asked for
+            madvise(p, bytes, MADV_RANDOM);
+            
+            ofScopedLock lock(mutex);
+            data = (unsigned char*)p;
+            mappedBytes = bytes;
+            slotBytes = bytes / numSlots;
+            this->numSlots = numSlots;
+            this->width = width;
+            this->height = height;
+            lru.clear();
+            lruPos.assign(numSlots, lru.end());
+            numResident = 0;
+            return true;
+#endif
+        }
+        
+        //--------------------------------------------------------------
+        bool write(int slot, const DepthFrame &frame) {
+            size_t numPixels = (size_t)width * height;
+#ifdef TARGET_WIN32
+            memcpy(getDepth(slot), &frame.depth[0], numPixels * sizeof(unsigned short));
+            memcpy(getRgb(slot), &frame.rgb[0], numPixels * 3);
+            return true;
+#else
+            // written through the file rather than the mapping, so overwriting a dropped slot doesn't first read it back in
+            return writeFile(getDepth(slot) - data, &frame.depth[0], numPixels * sizeof(unsigned short))
+                && writeFile(getRgb(slot) - data, &frame.rgb[0], numPixels * 3);
+#endif
+        }
+        
+        //--------------------------------------------------------------
+        void read(int slot, int rowBegin, int rowEnd, int columnBegin, int columnEnd, DepthRows &rows) {
+            touch(slot);
+            rows.depth = (unsigned short*)getDepth(slot) + (size_t)rowBegin * width;
+            rows.rgb = getRgb(slot) + (size_t)rowBegin * width * 3;
+        }
+        
+        //--------------------------------------------------------------
+        // start reading rows [rowBegin, rowEnd) of slot into the page cache
+        void prefetch(int slot, int rowBegin, int rowEnd) {
+#ifndef TARGET_WIN32
+            touch(slot);
+            size_t rowPixels = width;
+            advise(getDepth(slot) + rowBegin * rowPixels * sizeof(unsigned short), (rowEnd - rowBegin) * rowPixels * sizeof(unsigned short), MADV_WILLNEED);
+            advise(getRgb(slot) + rowBegin * rowPixels * 3, (rowEnd - rowBegin) * rowPixels * 3, MADV_WILLNEED);
+            __sync_fetch_and_add(&numPrefetched, 1);
+#endif
+        }
+        
+        //--------------------------------------------------------------
+        // bytes of slots touched since they were last dropped, which the process may hold (at most about maxResidentBytes)
+        size_t getBytesReserved() {
+            ofScopedLock lock(mutex);
+            return numResident * slotBytes;
+        }
+        
+        //--------------------------------------------------------------
+        // size of the file
+        size_t getBytesMapped() {
+            return mappedBytes;
+        }
+        
+        //--------------------------------------------------------------
+        // prefetches and slots dropped so far
+        unsigned long getNumPrefetched() {
+            return numPrefetched;
+        }
+        
+        unsigned long getNumEvicted() {
+            return numEvicted;
+        }
+    
+    protected:
+        string path;
+        int fd;
+        unsigned char *data;
+        size_t mappedBytes;
+        size_t slotBytes;
+        
+        ofMutex mutex;
+        size_t maxResidentBytes;
+        list<int> lru;                      // resident slots, most recently used first
+        vector<list<int>::iterator> lruPos; // per slot, lru.end() if not resident
+        size_t numResident;
+        volatile unsigned long numPrefetched;
+        volatile unsigned long numEvicted;
+        
+        //--------------------------------------------------------------
+        unsigned char* getDepth(int slot) {
+            return data + slot * slotBytes;
+        }
+        
+        unsigned char* getRgb(int slot) {
+            return getDepth(slot) + (size_t)width * height * sizeof(unsigned short);
+        }
+        
+        //--------------------------------------------------------------
+        // mark slot as most recently used, dropping the least recently used slots beyond maxResidentBytes
+        void touch(int slot) {
+            ofScopedLock lock(mutex);
+            if(lruPos[slot] != lru.end()) {
+                lru.splice(lru.begin(), lru, lruPos[slot]);
+                return;
+            }
+            lru.push_front(slot);
+            lruPos[slot] = lru.begin();
+            numResident++;
+            while(numResident > 1 && numResident * slotBytes > maxResidentBytes) {
+                int oldest = lru.back();
+                lru.pop_back();
+                lruPos[oldest] = lru.end();
+                numResident--;
+                
+                // shared file pages stay in the page cache (written back if dirty), only the process lets go of them
+#ifndef TARGET_WIN32
+                madvise(getDepth(oldest), slotBytes, MADV_DONTNEED);
+#endif
+                numEvicted++;
+            }
+        }
+
+#ifndef TARGET_WIN32
+        //--------------------------------------------------------------
+        // write size bytes at offset of the file (seen through the mapping too, as it's shared), returns false on failure
+        bool writeFile(size_t offset, const void *p, size_t size) {
+            const unsigned char *bytes = (const unsigned char*)p;
+            while(size > 0) {
+                ssize_t n = pwrite(fd, bytes, size, offset);
+                if(n < 0 && errno == EINTR) continue;
+                if(n <= 0) {
+                    ofLog(OF_LOG_ERROR, "MmapDepthFrameStore: can't write to " + path + ": " + (n < 0 ? strerror(errno) : "nothing written"));
+                    return false;
+                }
+                bytes += n;
+                offset += n;
+                size -= n;
+            }
+            return true;
+        }
+        
+        //--------------------------------------------------------------
+        // madvise on the pages holding [p, p + size)
+        void advise(unsigned char *p, size_t size, int advice) {
+            if(size == 0) return;
+            size_t pageSize = sysconf(_SC_PAGESIZE);
+            size_t begin = (size_t)(p - data) / pageSize * pageSize;
+            size_t end = (size_t)(p - data) + size;
+            madvise(data + begin, end - begin, advice);
+        }
+#endif
+
+        //--------------------------------------------------------------
+        void unmap() {
+#ifndef TARGET_WIN32
+            ofScopedLock lock(mutex);
+            if(data) munmap(data, mappedBytes);
+            if(fd >= 0) close(fd);
+#endif
+            data = NULL;
+            fd = -1;
+            mappedBytes = 0;
+            slotBytes = 0;
+            numSlots = 0;
+            lru.clear();
+            lruPos.clear();
+            numResident = 0;
+        }
+    };
+}
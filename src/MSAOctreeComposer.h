@@ -0,0 +1,253 @@
+#pragma once
+
+#include "ofMain.h"
+#include "MSASpaceTime.h"
+#include "MSATemporalGradient.h"
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // composes one point cloud from a SpaceTime of Morton ordered PointSpaces (a fine grid of 2^depth cells on each axis)
+    // through an octree refined every frame: starting from a single node, the node with the most points times the number of
+    // frames its gradient times span is split into its 8 children, until the leaf budget is used up or no node spans a frame
+    // each leaf then takes its points from the frame of the gradient time at its center, a single range of that frame in Morton order
+    // so cells are fine where the gradient changes quickly and there are points to show it, and coarse everywhere else
+    class OctreeComposer : protected ParallelJob {
+    public:
+        
+        //--------------------------------------------------------------
+        OctreeComposer() {
+            maxLeaves = 8192;
+            maxLevel = 0;
+            numChunks = 0;
+            phase = 0;
+        }
+        
+        //--------------------------------------------------------------
+        // most leaves per frame, composing costs about as much as a uniform grid with as many cells
+        void setMaxLeaves(int n) {
+            maxLeaves = max(1, n);
+        }
+        
+        int getMaxLeaves() {
+            return maxLeaves;
+        }
+        
+        //--------------------------------------------------------------
+        // number of leaves and deepest level (0 is the whole space) of the last composed frame
+        int getNumLeaves() {
+            return leaves.size();
+        }
+        
+        int getMaxLevel() {
+            return maxLevel;
+        }
+        
+        //--------------------------------------------------------------
+        // spaceTime holds Morton ordered spaces with 2^depth cells on each axis, gradient gives the time at any position (getTime)
+        void compose(SpaceTime<PointSpace> &spaceTime, TemporalGradient &gradient, int depth, vector<ofVec3f> &outVertices, vector<ofFloatColor> &outColors, ThreadPool *pool = NULL) {
+            int numFrames = spaceTime.getNumFrames();
+            if(numFrames == 0) {
+                leaves.clear();
+                outVertices.clear();
+                outColors.clear();
+                return;
+            }
+            
+            frames.resize(numFrames);
+            for(int f=0; f<numFrames; f++) frames[f] = spaceTime.getSpaceAtFrame(f);
+            refine(gradient, depth);
+            numChunks = min((int)leaves.size(), pool ? pool->getNumThreads() * 8 : 1);
+            
+            // pass 1: count points of each leaf in its source frame
+            run(0, pool);
+            
+            // prefix sum counts into output offsets and size output once
+            unsigned int numPoints = 0;
+            for(int i=0; i<leaves.size(); i++) {
+                leaves[i].outOffset = numPoints;
+                numPoints += leaves[i].numPoints;
+            }
+            outVertices.resize(numPoints);
+            outColors.resize(numPoints);
+            this->outVertices = numPoints > 0 ? &outVertices[0] : NULL;
+            this->outColors = numPoints > 0 ? &outColors[0] : NULL;
+            
+            // pass 2: copy every leaf into its output range
+            if(numPoints > 0) run(1, pool);
+        }
+    
+    protected:
+        struct Node {
+            unsigned int code;      // Morton code of the node's first fine cell
+            int level;              // 0 for the whole space, depth for a single fine cell
+            int i, j, k;            // first fine cell on each axis
+            int slotBegin, slotEnd; // slots of the node in the newest frame
+            int age;                // frame of the gradient time at the center
+            float priority;         // points times frames spanned, 0 if it doesn't span frames or has no points
+            
+            bool operator<(const Node &other) const {
+                return priority < other.priority;
+            }
+        };
+        
+        struct Leaf {
+            unsigned int cellBegin, cellEnd;
+            int age;
+            unsigned int numPoints;
+            unsigned int outOffset;
+            
+            bool operator<(const Leaf &other) const {
+                return cellBegin < other.cellBegin;
+            }
+        };
+        
+        int maxLeaves;
+        int maxLevel;
+        vector<PointSpace*> frames;     // frames by age
+        vector<Node> heap;              // nodes worth splitting, by priority
+        vector<Leaf> leaves;            // in Morton order
+        int numChunks;
+        int phase;
+        ofVec3f *outVertices;
+        ofFloatColor *outColors;
+        
+        //--------------------------------------------------------------
+        // build the leaves for gradient, splitting the nodes with the most points times frames spanned first
+        void refine(TemporalGradient &gradient, int depth) {
+            leaves.clear();
+            heap.clear();
+            maxLevel = 0;
+            
+            Node root;
+            root.code = 0;
+            root.level = 0;
+            root.i = root.j = root.k = 0;
+            root.slotBegin = 0;
+            root.slotEnd = frames[0]->getNumSlots();
+            float tMin = 1, tMax = 0;
+            for(int c=0; c<8; c++) {
+                float t = gradient.getTime(c & 1, (c >> 1) & 1, (c >> 2) & 1);
+                tMin = min(tMin, t);
+                tMax = max(tMax, t);
+            }
+            evaluate(root, gradient.getTime(0.5f, 0.5f, 0.5f), tMin, tMax, depth);
+            push(root, depth);
+            
+            // splitting replaces a node with 8, the heap only holds nodes worth splitting
+            while(!heap.empty() && leaves.size() + heap.size() + 7 <= maxLeaves) {
+                std::pop_heap(heap.begin(), heap.end());
+                Node node = heap.back();
+                heap.pop_back();
+                split(node, gradient, depth);
+            }
+            for(int i=0; i<heap.size(); i++) addLeaf(heap[i], depth);
+            std::sort(leaves.begin(), leaves.end());
+        }
+        
+        //--------------------------------------------------------------
+        // evaluate the 8 children of node and add them to the heap
+        void split(const Node &node, TemporalGradient &gradient, int depth) {
+            int childLevel = node.level + 1;
+            int childSize = 1 << (depth - childLevel);
+            unsigned int childCells = 1u << (3 * (depth - childLevel));
+            float cellSize = 1.0f / (1 << depth);
+            float h = childSize * cellSize;
+            float u = node.i * cellSize, v = node.j * cellSize, w = node.k * cellSize;
+            
+            // gradient times on the 3 x 3 x 3 lattice of the children's corners, which they share
+            float times[27];
+            for(int z=0, n=0; z<3; z++) for(int y=0; y<3; y++) for(int x=0; x<3; x++, n++) times[n] = gradient.getTime(u + x * h, v + y * h, w + z * h);
+            
+            // the children's slots in the newest frame lie within the node's
+            int slots[9];
+            slots[0] = node.slotBegin;
+            slots[8] = node.slotEnd;
+            for(int c=1; c<8; c++) slots[c] = frames[0]->getSlotBound(node.code + c * childCells, slots[c - 1], node.slotEnd);
+            
+            for(int c=0; c<8; c++) {
+                int x = c & 1, y = (c >> 1) & 1, z = (c >> 2) & 1;
+                Node child;
+                child.level = childLevel;
+                child.i = node.i + x * childSize;
+                child.j = node.j + y * childSize;
+                child.k = node.k + z * childSize;
+                child.code = node.code + c * childCells;
+                child.slotBegin = slots[c];
+                child.slotEnd = slots[c + 1];
+                float tMin = 1, tMax = 0;
+                for(int corner=0; corner<8; corner++) {
+                    float t = times[((z + ((corner >> 2) & 1)) * 3 + y + ((corner >> 1) & 1)) * 3 + x + (corner & 1)];
+                    tMin = min(tMin, t);
+                    tMax = max(tMax, t);
+                }
+                evaluate(child, gradient.getTime(u + (x + 0.5f) * h, v + (y + 0.5f) * h, w + (z + 0.5f) * h), tMin, tMax, depth);
+                push(child, depth);
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // add node to the heap if it's worth splitting, or make it a leaf
+        void push(const Node &node, int depth) {
+            if(node.priority <= 0) {
+                addLeaf(node, depth);
+                return;
+            }
+            heap.push_back(node);
+            std::push_heap(heap.begin(), heap.end());
+        }
+        
+        //--------------------------------------------------------------
+        // set age and priority of node from the gradient times at its center and corners (tMin, tMax)
+        void evaluate(Node &node, float tCenter, float tMin, float tMax, int depth) {
+            int numFrames = frames.size();
+            node.age = ofClamp(floor(tCenter * (numFrames - 1)), 0, numFrames - 1);
+            node.priority = 0;
+            if(node.level == depth) return;
+            
+            // frames the node spans, as far as its corners and center tell
+            tMin = min(tMin, tCenter);
+            tMax = max(tMax, tCenter);
+            int span = floor(tMax * (numFrames - 1)) - floor(tMin * (numFrames - 1));
+            if(span == 0) return;
+            
+            // points in the node now and in the frame it shows
+            int numPoints = frames[0]->getSlotOffset(node.slotEnd) - frames[0]->getSlotOffset(node.slotBegin);
+            if(node.age > 0) numPoints += frames[node.age]->getRangeNumPoints(node.code, node.code + (1u << (3 * (depth - node.level))));
+            node.priority = span * numPoints;
+        }
+        
+        //--------------------------------------------------------------
+        void addLeaf(const Node &node, int depth) {
+            Leaf leaf;
+            leaf.cellBegin = node.code;
+            leaf.cellEnd = node.code + (1u << (3 * (depth - node.level)));
+            leaf.age = node.age;
+            leaf.numPoints = 0;
+            leaf.outOffset = 0;
+            leaves.push_back(leaf);
+            maxLevel = max(maxLevel, node.level);
+        }
+        
+        //--------------------------------------------------------------
+        void run(int phase, ThreadPool *pool) {
+            this->phase = phase;
+            if(pool) pool->run(*this, numChunks);
+            else for(int i=0; i<numChunks; i++) runTask(i);
+        }
+        
+        //--------------------------------------------------------------
+        void runTask(int chunk) {
+            int lBegin = (long long)chunk * leaves.size() / numChunks;
+            int lEnd = (long long)(chunk + 1) * leaves.size() / numChunks;
+            for(int l=lBegin; l<lEnd; l++) {
+                Leaf &leaf = leaves[l];
+                PointSpace *frame = frames[leaf.age];
+                if(phase == 0) leaf.numPoints = frame->getRangeNumPoints(leaf.cellBegin, leaf.cellEnd);
+                else if(leaf.numPoints > 0) frame->copyRangePoints(leaf.cellBegin, leaf.cellEnd, outVertices + leaf.outOffset, outColors + leaf.outOffset);
+            }
+        }
+    };
+}
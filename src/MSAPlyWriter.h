@@ -0,0 +1,205 @@
+#pragma once
+
+#include "ofMain.h"
+#include "MSAFrameQueue.h"
+
+namespace msa {
+
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // writes point clouds as binary little endian PLY (float x, y, z and uchar red, green, blue per vertex)
+    // straight from vertex and color arrays, a fraction of the size and time of ofMesh::save's ascii PLY
+    class PlyWriter {
+    public:
+
+        //--------------------------------------------------------------
+        // write numPoints vertices (and colors, if not NULL) to path (relative to data folder), returns false on failure
+        static bool save(string path, const ofVec3f *vertices, const ofFloatColor *colors, int numPoints) {
+            FILE *file = fopen(ofToDataPath(path).c_str(), "wb");
+            if(file == NULL) return false;
+
+            string header = getHeader(numPoints, colors != NULL);
+            bool ok = fwrite(header.c_str(), 1, header.size(), file) == header.size();
+
+            // convert and write in blocks, so memory use doesn't grow with the cloud
+            const int blockSize = 4096;
+            int vertexSize = colors ? 15 : 12;
+            vector<unsigned char> block(blockSize * vertexSize);
+            for(int start=0; ok && start<numPoints; start += blockSize) {
+                int n = min(blockSize, numPoints - start);
+                unsigned char *p = &block[0];
+                for(int i=start; i<start + n; i++) {
+                    putFloat(vertices[i].x, p);
+                    putFloat(vertices[i].y, p);
+                    putFloat(vertices[i].z, p);
+                    if(colors) {
+                        *p++ = ofClamp(colors[i].r, 0, 1) * 255;
+                        *p++ = ofClamp(colors[i].g, 0, 1) * 255;
+                        *p++ = ofClamp(colors[i].b, 0, 1) * 255;
+                    }
+                }
+                ok = fwrite(&block[0], 1, n * vertexSize, file) == n * vertexSize;
+            }
+
+            if(fclose(file) != 0) ok = false;
+            return ok;
+        }
+
+        //--------------------------------------------------------------
+        static string getHeader(int numPoints, bool hasColors) {
+            stringstream s;
+            s << "ply" << "\n"
+            << "format binary_little_endian 1.0" << "\n"
+            << "element vertex " << numPoints << "\n"
+            << "property float x" << "\n"
+            << "property float y" << "\n"
+            << "property float z" << "\n";
+            if(hasColors) {
+                s << "property uchar red" << "\n"
+                << "property uchar green" << "\n"
+                << "property uchar blue" << "\n";
+            }
+            s << "end_header" << "\n";
+            return s.str();
+        }
+
+    protected:
+        //--------------------------------------------------------------
+        static void putFloat(float f, unsigned char *&p) {
+            unsigned int v;
+            memcpy(&v, &f, 4);
+            for(int i=0; i<4; i++) *p++ = v >> (i * 8);
+        }
+    };
+
+
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // saves point clouds with PlyWriter on its own thread, so saving never stalls the caller
+    // save() takes a copy of the arrays (the caller's buffers are usually reused right away) and queues it,
+    // results are reported through the counters and getStatus()
+    class PlyExporter : public ofThread {
+    public:
+        
+        //--------------------------------------------------------------
+        PlyExporter() {
+            numSaved = 0;
+            numFailed = 0;
+            queue.setDropPolicy(FRAME_DROP_NEWEST);
+            status = "idle";
+        }
+        
+        //--------------------------------------------------------------
+        ~PlyExporter() {
+            stop();
+        }
+        
+        //--------------------------------------------------------------
+        // start the writer thread with up to queueCapacity clouds waiting to be written
+        // when the queue is full, save() refuses new clouds (blocking = false) or waits for space (blocking = true)
+        void setup(int queueCapacity = 2, bool blocking = false) {
+            stop();
+            queue.setCapacity(queueCapacity);
+            queue.setDropPolicy(blocking ? FRAME_BLOCK : FRAME_DROP_NEWEST);
+            startThread(false, false);
+        }
+        
+        //--------------------------------------------------------------
+        // write the remaining queued clouds and join the thread
+        void stop() {
+            if(!isThreadRunning()) return;
+            queue.close();
+            waitForThread(true);
+        }
+        
+        //--------------------------------------------------------------
+        // queue a copy of the cloud to be saved to path (relative to data folder)
+        // colors are written if there are as many as vertices, returns false if the queue was full
+        bool save(string path, const vector<ofVec3f> &vertices, const vector<ofFloatColor> &colors) {
+            pending.path = path;
+            pending.vertices.assign(vertices.begin(), vertices.end());
+            pending.colors.assign(colors.begin(), colors.end());
+            if(queue.push(pending)) return true;
+            setStatus("queue full, not saved " + path);
+            return false;
+        }
+        
+        //--------------------------------------------------------------
+        // number of clouds waiting to be written, written, failed to write, and refused because the queue was full
+        int getNumPending() {
+            return queue.getSize();
+        }
+        
+        int getNumSaved() {
+            return __sync_fetch_and_add(&numSaved, 0);
+        }
+        
+        int getNumFailed() {
+            return __sync_fetch_and_add(&numFailed, 0);
+        }
+        
+        unsigned long getNumRejected() {
+            return queue.getNumDropped();
+        }
+        
+        //--------------------------------------------------------------
+        // result of the most recent save
+        string getStatus() {
+            ofScopedLock lock(statusMutex);
+            return status;
+        }
+        
+    protected:
+        struct Job {
+            string path;
+            vector<ofVec3f> vertices;
+            vector<ofFloatColor> colors;
+            
+            void swap(Job &other) {
+                path.swap(other.path);
+                vertices.swap(other.vertices);
+                colors.swap(other.colors);
+            }
+        };
+        
+        FrameQueue<Job> queue;
+        Job pending;                // only touched by the caller of save
+        volatile int numSaved;
+        volatile int numFailed;
+        ofMutex statusMutex;
+        string status;
+        
+        //--------------------------------------------------------------
+        void setStatus(string s) {
+            ofScopedLock lock(statusMutex);
+            status = s;
+        }
+        
+        //--------------------------------------------------------------
+        void threadedFunction() {
+            Job job;
+            while(queue.waitPop(job)) write(job);
+            while(queue.pop(job)) write(job);       // closed, write what's left
+        }
+        
+        //--------------------------------------------------------------
+        void write(const Job &job) {
+            unsigned long long t0 = ofGetElapsedTimeMicros();
+            int numPoints = job.vertices.size();
+            ofFloatColor noColor;   // empty clouds still get color properties, like the rest of a sequence
+            const ofFloatColor *colors = job.colors.size() != numPoints ? NULL : numPoints ? &job.colors[0] : &noColor;
+            bool ok = PlyWriter::save(job.path, numPoints ? &job.vertices[0] : NULL, colors, numPoints);
+            int millis = (ofGetElapsedTimeMicros() - t0) / 1000;
+            if(ok) {
+                __sync_fetch_and_add(&numSaved, 1);
+                setStatus("saved " + job.path + " (" + ofToString(numPoints) + " points, " + ofToString(millis) + " ms)");
+            } else {
+                __sync_fetch_and_add(&numFailed, 1);
+                setStatus("FAILED to save " + job.path);
+                ofLog(OF_LOG_ERROR, "PlyExporter: can't write " + job.path);
+            }
+        }
+    };
+}
@@ -0,0 +1,652 @@
+#pragma once
+
+#include "ofMain.h"
+#include "MSASpaceTime.h"
+#include "MSAOctreeComposer.h"
+#include "MSADepthHistory.h"
+#include "MSATemporalGradient.h"
+#include "MSADepthToWorld.h"
+#include "MSADepthFrame.h"
+#include "MSAThreadPool.h"
+#include "MSAStats.h"
+#include "MSATrace.h"
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // the slitscan engine: converts DepthFrames into binned PointSpaces (ingest), keeps them in a
+    // SpaceTime history and composes the output point cloud through a TemporalGradient (compose)
+    // or, with raw history, keeps the frames themselves in a DepthHistory (addFrame) and converts them while composing
+    // ingest and addSpace / addFrame / compose may run on two different threads, settings can be changed from any thread
+    // each of the two has its own worker threads, so a composition never waits for an ingest to finish with them (or vice versa)
+    class SlitScan : protected ParallelJob {
+    public:
+        
+        //--------------------------------------------------------------
+        SlitScan() {
+            nearThreshold = 0;
+            farThreshold = 3000;
+            webcamNear = 1000;
+            webcamFar = 2000;
+            pixelStep = 1;
+            numScanFrames = 240;
+            compact = false;
+            sparse = false;
+            adaptive = false;
+            adaptiveDepth = 8;
+            adaptiveMaxLeaves = 8192;
+            rawHistory = false;
+            debugInfo = false;
+            boundaryMin.set(-400, -400, 400);
+            boundaryMax.set(400, 400, 3000);
+            gradientMode = 0;
+            numCells = getGradientModeNumCells(gradientMode);
+            historyGradientMode = -1;
+            historyAdaptive = false;
+            historyDepth = 0;
+            historyRaw = false;
+            historyBytes = 0;
+            historyNumLeaves = 0;
+            historyRowsRead = 0;
+            historyStoreFailed = false;
+            ingestFrame = NULL;
+            stats = NULL;
+            tracer = NULL;
+            
+            spaceTime.setPool(&spacePool);
+        }
+        
+        //--------------------------------------------------------------
+        // start worker threads, numThreads for each of ingest and compose (0 for one per core)
+        void setup(int numThreads = 0) {
+            setup(numThreads, numThreads);
+        }
+        
+        //--------------------------------------------------------------
+        // start numIngestThreads worker threads for ingest and numComposeThreads for compose (0 for one per core)
+        void setup(int numIngestThreads, int numComposeThreads) {
+            ingestPool.setup(numIngestThreads);
+            composePool.setup(numComposeThreads);
+            builder.setNumBands(ingestPool.getNumThreads() * 2);
+            depthRows.resize(builder.getNumBands());
+        }
+        
+        //--------------------------------------------------------------
+        void stop() {
+            ingestPool.stop();
+            composePool.stop();
+        }
+        
+        //--------------------------------------------------------------
+        // rays used to convert raw depth to world positions
+        DepthToWorld& getDepthToWorld() {
+            return depthToWorld;
+        }
+        
+        //--------------------------------------------------------------
+        ThreadPool& getIngestPool() {
+            return ingestPool;
+        }
+        
+        ThreadPool& getComposePool() {
+            return composePool;
+        }
+        
+        //--------------------------------------------------------------
+        // time the stages into stats (NULL to stop timing), set before the stages start running
+        void setStats(Stats *stats) {
+            this->stats = stats;
+        }
+        
+        //--------------------------------------------------------------
+        // trace the stages into tracer (NULL to stop tracing), set before the stages start running
+        void setTracer(Tracer *tracer) {
+            this->tracer = tracer;
+        }
+        
+        //--------------------------------------------------------------
+        Tracer* getTracer() {
+            return tracer;
+        }
+
+
+        //--------------------------------------------------------------
+        // name of gradient mode (0-9)
+        static string getGradientModeName(int mode) {
+            switch(mode) {
+                case 1: return "left-right";
+                case 2: return "right-left";
+                case 3: return "top-bottom";
+                case 4: return "bottom-top";
+                case 5: return "front-back";
+                case 6: return "back-front";
+                case 7: return "spherical";
+                case 8: return "random";
+                case 9: return "oldest";
+                default: return "most recent";
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // spatial resolution used for gradient mode (0-9)
+        static ofVec3f getGradientModeNumCells(int mode) {
+            switch(mode) {
+                case 1:
+                case 2: return ofVec3f(500, 1, 1);
+                case 3:
+                case 4: return ofVec3f(1, 500, 1);
+                case 5:
+                case 6: return ofVec3f(1, 1, 500);
+                case 7: return ofVec3f(30, 30, 30);
+                case 8: return ofVec3f(40, 40, 40);
+                default: return ofVec3f(2, 2, 2);
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // set gradient mode (0-9), the history is cleared before the next frame is composed
+        void setGradientMode(int mode) {
+            ofScopedLock lock(mutex);
+            gradientMode = mode;
+            numCells = getGradientModeNumCells(mode);
+            
+            ofLog(OF_LOG_VERBOSE, "setGradientMode: " + ofToString(gradientMode) + " " + getGradientModeName(gradientMode) + " (" + ofToString(numCells.x) + ", " + ofToString(numCells.y) + ", " + ofToString(numCells.z) + ")");
+        }
+        
+        //--------------------------------------------------------------
+        int getGradientMode() {
+            ofScopedLock lock(mutex);
+            return gradientMode;
+        }
+        
+        //--------------------------------------------------------------
+        // override the spatial resolution of the current gradient mode (until the next setGradientMode)
+        void setNumCells(ofVec3f n) {
+            ofScopedLock lock(mutex);
+            numCells.set(max(1.0f, floorf(n.x)), max(1.0f, floorf(n.y)), max(1.0f, floorf(n.z)));
+        }
+        
+        //--------------------------------------------------------------
+        ofVec3f getNumCells() {
+            ofScopedLock lock(mutex);
+            return numCells;
+        }
+        
+        //--------------------------------------------------------------
+        // duration (in frames) for full scan
+        void setNumScanFrames(int n) {
+            ofScopedLock lock(mutex);
+            numScanFrames = n;
+        }
+        
+        //--------------------------------------------------------------
+        int getNumScanFrames() {
+            ofScopedLock lock(mutex);
+            return numScanFrames;
+        }
+        
+        //--------------------------------------------------------------
+        // depth range (millimetres) of points to keep
+        void setThresholds(float nearThreshold, float farThreshold) {
+            ofScopedLock lock(mutex);
+            this->nearThreshold = nearThreshold;
+            this->farThreshold = farThreshold;
+        }
+        
+        //--------------------------------------------------------------
+        // depth range webcam brightness is mapped onto (if there is no depth)
+        void setWebcamRange(float webcamNear, float webcamFar) {
+            ofScopedLock lock(mutex);
+            this->webcamNear = webcamNear;
+            this->webcamFar = webcamFar;
+        }
+        
+        //--------------------------------------------------------------
+        // physical boundaries of space time continuum
+        void setBoundaries(ofVec3f bmin, ofVec3f bmax) {
+            ofScopedLock lock(mutex);
+            boundaryMin = bmin;
+            boundaryMax = bmax;
+        }
+        
+        //--------------------------------------------------------------
+        // how many pixels to step through the depth map when iterating
+        void setPixelStep(int step) {
+            ofScopedLock lock(mutex);
+            pixelStep = max(1, step);
+        }
+        
+        //--------------------------------------------------------------
+        // store new frames quantized (see PointSpace::setCompact)
+        void setCompact(bool b) {
+            ofScopedLock lock(mutex);
+            compact = b;
+        }
+        
+        //--------------------------------------------------------------
+        // store only the occupied cells of new frames (see PointSpace::setSparse), for fine grids with mostly empty cells
+        void setSparse(bool b) {
+            ofScopedLock lock(mutex);
+            sparse = b;
+        }
+        
+        //--------------------------------------------------------------
+        // compose through an OctreeComposer refined every frame instead of the gradient mode's uniform cells
+        // new frames are binned sparse and in Morton order into 2^depth cells on each axis (depth 8 is 256 x 256 x 256)
+        void setAdaptive(bool b) {
+            ofScopedLock lock(mutex);
+            adaptive = b;
+        }
+        
+        //--------------------------------------------------------------
+        bool getAdaptive() {
+            ofScopedLock lock(mutex);
+            return adaptive;
+        }
+        
+        //--------------------------------------------------------------
+        // most octree leaves per composed frame (see OctreeComposer::setMaxLeaves)
+        void setAdaptiveMaxLeaves(int n) {
+            ofScopedLock lock(mutex);
+            adaptiveMaxLeaves = max(1, n);
+        }
+        
+        //--------------------------------------------------------------
+        int getAdaptiveMaxLeaves() {
+            ofScopedLock lock(mutex);
+            return adaptiveMaxLeaves;
+        }
+        
+        //--------------------------------------------------------------
+        // depth of the finest octree level (1-10)
+        void setAdaptiveDepth(int depth) {
+            ofScopedLock lock(mutex);
+            adaptiveDepth = ofClamp(depth, 1, 10);
+        }
+        
+        //--------------------------------------------------------------
+        // keep raw depth + color frames (addFrame) instead of binned spaces (ingest, addSpace), see DepthHistory
+        // the history then survives threshold, boundary, cell and gradient mode changes, composes through uniform cells
+        // (not adaptive) and only holds frames with depth
+        void setRawHistory(bool b) {
+            ofScopedLock lock(mutex);
+            rawHistory = b;
+        }
+        
+        //--------------------------------------------------------------
+        bool getRawHistory() {
+            ofScopedLock lock(mutex);
+            return rawHistory;
+        }
+        
+        //--------------------------------------------------------------
+        // frame store of the raw history (NULL for plain images in memory), set before the stages start running
+        void setFrameStore(DepthFrameStore *store) {
+            depthHistory.setStore(store);
+        }
+        
+        //--------------------------------------------------------------
+        // print per cell info while composing
+        void setDebugInfo(bool b) {
+            ofScopedLock lock(mutex);
+            debugInfo = b;
+        }
+
+
+        //--------------------------------------------------------------
+        // stage 1: convert frame to points and bin them into a new PointSpace
+        PointSpace* ingest(const DepthFrame &frame) {
+            mutex.lock();
+            ingestSettings.nearThreshold = nearThreshold;
+            ingestSettings.farThreshold = farThreshold;
+            ingestSettings.webcamNear = webcamNear;
+            ingestSettings.webcamFar = webcamFar;
+            ingestSettings.pixelStep = pixelStep;
+            ingestSettings.boundaryMin = boundaryMin;
+            ingestSettings.boundaryMax = boundaryMax;
+            ofVec3f spaceNumCells = getSpaceNumCells();
+            SpaceFormat spaceFormat(compact, sparse || adaptive, adaptive);
+            int spaceGradientMode = gradientMode;
+            mutex.unlock();
+            
+            PointSpace *space = spacePool.getSpace(spaceNumCells, ingestSettings.boundaryMin, ingestSettings.boundaryMax, spaceFormat);
+            
+            // iterate all pixels in bands of rows on all threads, and collect the ones in range
+            {
+                ScopedTimer timer(stats, "depth to world");
+                ScopedTrace trace(tracer, "depth to world", frame.frameNum, spaceGradientMode);
+                ingestFrame = &frame;
+                ingestPool.run(*this, builder.getNumBands());
+                ingestFrame = NULL;
+                trace.setPoints(builder.getNumPoints());
+            }
+            
+            // add all collected points to relevant quantum cells
+            {
+                ScopedTimer timer(stats, "binning");
+                ScopedTrace trace(tracer, "binning", frame.frameNum, spaceGradientMode);
+                builder.build(*space, &ingestPool);
+                trace.setPoints(space->getNumPoints());
+                trace.setCells(space->getNumCellsTotal());
+            }
+            return space;
+        }
+        
+        //--------------------------------------------------------------
+        // stage 2: add space to space time continuum (takes ownership)
+        void addSpace(PointSpace *space) {
+            ScopedTimer timer(stats, "addSpace");
+            ScopedTrace trace(tracer, "addSpace");
+            updateHistory();
+            if(historyRaw || space->getNumCells() != spaceTime.getSpaceNumCells() || space->getMortonOrder() != historyAdaptive) {
+                recycleSpace(space);    // binned before a gradient mode, adaptive or raw history change
+                return;
+            }
+            spaceTime.addSpace(space);
+        }
+        
+        //--------------------------------------------------------------
+        // stage 2 with raw history: copy frame into the history (ignored without raw history or depth)
+        void addFrame(const DepthFrame &frame) {
+            ScopedTimer timer(stats, "addFrame");
+            ScopedTrace trace(tracer, "addFrame", frame.frameNum);
+            updateHistory();
+            if(historyRaw) depthHistory.addFrame(frame);
+        }
+        
+        //--------------------------------------------------------------
+        // stage 2: compose output, drawing each cell from the frame its age in the gradient table points to
+        void compose(vector<ofVec3f> &outVertices, vector<ofFloatColor> &outColors) {
+            ScopedTimer timer(stats, "compose");
+            ScopedTrace trace(tracer, "compose");
+            updateHistory();
+            if(historyRaw) {
+                composeRaw(outVertices, outColors);
+                return;
+            }
+            if(historyAdaptive) {
+                octree.compose(spaceTime, gradient, historyDepth, outVertices, outColors, &composePool);
+                trace.setMode(historyGradientMode);
+                trace.setPoints(outVertices.size());
+                trace.setCells(octree.getNumLeaves());
+                
+                size_t bytes = spaceTime.getBytesReserved();
+                ofScopedLock lock(mutex);
+                historyBytes = bytes;
+                historyNumLeaves = octree.getNumLeaves();
+                historyStoreFailed = false;
+                return;
+            }
+            gradient.setNumFrames(spaceTime.getNumFrames());
+            gradient.nextFrame();
+            const int *cellAges = gradient.getCellAges();
+            int numCellsTotal = gradient.getNumCellsTotal();
+            composer.compose(spaceTime, cellAges, numCellsTotal, outVertices, outColors, &composePool);
+            trace.setMode(historyGradientMode);
+            trace.setPoints(outVertices.size());
+            trace.setCells(numCellsTotal);
+            
+            if(isDebugInfo() && spaceTime.getNumFrames() > 0) {
+                for(int cell=0; cell<numCellsTotal; cell++) {
+                    int cellNumPoints = spaceTime.getSpaceAtFrame(cellAges[cell])->getCellNumPoints(cell);
+                    if(cellNumPoints>0) printf("UPDATE MESH cell: %i, age: %i, numVertices: %i\n", cell, cellAges[cell], cellNumPoints);
+                }
+            }
+            
+            size_t bytes = spaceTime.getBytesReserved();
+            ofScopedLock lock(mutex);
+            historyBytes = bytes;
+            historyNumLeaves = 0;
+            historyStoreFailed = false;
+        }
+        
+        //--------------------------------------------------------------
+        // compose from the raw history with the current settings
+        void composeRaw(vector<ofVec3f> &outVertices, vector<ofFloatColor> &outColors) {
+            ScopedTrace trace(tracer, "compose raw");
+            mutex.lock();
+            DepthHistory::Settings settings;
+            settings.nearThreshold = nearThreshold;
+            settings.farThreshold = farThreshold;
+            settings.pixelStep = pixelStep;
+            settings.boundaryMin = boundaryMin;
+            settings.boundaryMax = boundaryMax;
+            settings.numCells = numCells;
+            mutex.unlock();
+            
+            gradient.setNumFrames(depthHistory.getNumFrames());
+            gradient.nextFrame();
+            depthHistory.compose(gradient.getCellAges(), settings, depthToWorld, outVertices, outColors, &composePool);
+            trace.setMode(historyGradientMode);
+            trace.setPoints(outVertices.size());
+            trace.setCells(gradient.getNumCellsTotal());
+            
+            size_t bytes = depthHistory.getBytesReserved();
+            ofScopedLock lock(mutex);
+            historyBytes = bytes;
+            historyNumLeaves = 0;
+            historyRowsRead = depthHistory.getNumRowsRead();
+            historyStoreFailed = depthHistory.getStoreFailed();
+        }
+        
+        //--------------------------------------------------------------
+        // output all points of a single space (no slitscan)
+        void getPoints(PointSpace *space, vector<ofVec3f> &outVertices, vector<ofFloatColor> &outColors) {
+            int numPoints = space->getNumPoints();
+            outVertices.resize(numPoints);
+            outColors.resize(numPoints);
+            if(numPoints > 0) space->copyPoints(&outVertices[0], &outColors[0]);
+            
+            if(isDebugInfo()) {
+                ofVec3f maxP(-10000, -10000, -10000);
+                ofVec3f minP( 10000,  10000,  10000);
+                for(int i=0; i<numPoints; i++) {
+                    ofVec3f &p = outVertices[i];
+                    if(p.x < minP.x) minP.x = p.x;
+                    if(p.x > maxP.x) maxP.x = p.x;
+                    
+                    if(p.y < minP.y) minP.y = p.y;
+                    if(p.y > maxP.y) maxP.y = p.y;
+                    
+                    if(p.z < minP.z) minP.z = p.z;
+                    if(p.z > maxP.z) maxP.z = p.z;
+                }
+                printf("Boundaries: (%f, %f, %f) - (%f, %f, %f)\n", minP.x, minP.y, minP.z, maxP.x, maxP.y, maxP.z);
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // hand a space which won't be added to the history back for reuse
+        void recycleSpace(PointSpace *space) {
+            if(space) spacePool.releaseSpace(space);
+        }
+
+
+        //--------------------------------------------------------------
+        SpacePool<PointSpace>& getSpacePool() {
+            return spacePool;
+        }
+        
+        //--------------------------------------------------------------
+        // bytes held by the history as of the last compose
+        size_t getHistoryBytes() {
+            ofScopedLock lock(mutex);
+            return historyBytes;
+        }
+        
+        //--------------------------------------------------------------
+        // image rows converted by the last compose from the raw history
+        int getNumRowsRead() {
+            ofScopedLock lock(mutex);
+            return historyRowsRead;
+        }
+        
+        //--------------------------------------------------------------
+        // true if the raw history's frame store failed to allocate or write as of the last compose (see DepthHistory::getStoreFailed)
+        bool getHistoryFailed() {
+            ofScopedLock lock(mutex);
+            return historyStoreFailed;
+        }
+        
+        //--------------------------------------------------------------
+        // octree leaves of the last composed frame (0 if not adaptive)
+        int getNumLeaves() {
+            ofScopedLock lock(mutex);
+            return historyNumLeaves;
+        }
+    
+    protected:
+        ofMutex mutex;      // guards settings
+        float nearThreshold, farThreshold;
+        float webcamNear, webcamFar;
+        int pixelStep;
+        int numScanFrames;
+        bool compact;
+        bool sparse;
+        bool adaptive;
+        int adaptiveDepth;
+        int adaptiveMaxLeaves;
+        bool rawHistory;
+        bool debugInfo;
+        ofVec3f boundaryMin, boundaryMax;
+        int gradientMode;
+        ofVec3f numCells;
+        size_t historyBytes;
+        int historyNumLeaves;
+        int historyRowsRead;
+        bool historyStoreFailed;
+        
+        ThreadPool ingestPool;
+        ThreadPool composePool;
+        DepthToWorld depthToWorld;
+        Stats *stats;
+        Tracer *tracer;
+        
+        // ingest stage
+        struct IngestSettings {
+            float nearThreshold, farThreshold;
+            float webcamNear, webcamFar;
+            int pixelStep;
+            ofVec3f boundaryMin, boundaryMax;
+        } ingestSettings;
+        struct DepthRow {
+            vector<float> x, y, z;
+            vector<unsigned char> valid;
+        };
+        vector<DepthRow> depthRows;         // one converted row per band
+        PointSpaceBuilder builder;          // points of the incoming frame in bands of image rows
+        const DepthFrame *ingestFrame;
+        
+        // compose stage
+        SpacePool<PointSpace> spacePool;    // frames evicted from spaceTime, reused for new frames
+        SpaceTime<PointSpace> spaceTime;    // space time continuum
+        TemporalGradient gradient;          // frame age of each cell for the history's gradient mode
+        PointSpaceTimeComposer composer;
+        OctreeComposer octree;              // instead of gradient table and composer when adaptive
+        int historyGradientMode;
+        bool historyAdaptive;
+        int historyDepth;
+        DepthHistory depthHistory;          // instead of spaceTime with raw history
+        bool historyRaw;
+        ofVec3f historyNumCells;            // of the gradient table with raw history
+        
+        //--------------------------------------------------------------
+        bool isDebugInfo() {
+            ofScopedLock lock(mutex);
+            return debugInfo;
+        }
+        
+        //--------------------------------------------------------------
+        // cells of new spaces: the gradient mode's, or the finest octree level if adaptive (call with mutex locked)
+        ofVec3f getSpaceNumCells() {
+            if(!adaptive) return numCells;
+            float n = 1 << adaptiveDepth;
+            return ofVec3f(n, n, n);
+        }
+        
+        //--------------------------------------------------------------
+        // apply gradient mode, adaptive, raw history and scan length changes to the history (compose stage only)
+        void updateHistory() {
+            ofScopedLock lock(mutex);
+            if(historyRaw != rawHistory) {
+                spaceTime.clear();
+                depthHistory.clear();
+                historyRaw = rawHistory;
+                historyGradientMode = -1;
+            }
+            if(historyRaw) {
+                // raw frames don't depend on the cells, only the gradient table does
+                if(historyGradientMode != gradientMode || historyNumCells != numCells) {
+                    gradient.setup(gradientMode, numCells);
+                    historyGradientMode = gradientMode;
+                    historyNumCells = numCells;
+                }
+                depthHistory.setMaxFrames(numScanFrames);
+                return;
+            }
+            
+            ofVec3f spaceNumCells = getSpaceNumCells();
+            if(historyGradientMode != gradientMode || historyAdaptive != adaptive || spaceTime.getSpaceNumCells() != spaceNumCells) {
+                spaceTime.clear();
+                spaceTime.setSpaceNumCells(spaceNumCells);
+                // the octree samples getTime directly, the table is only needed for uniform cells
+                gradient.setup(gradientMode, adaptive ? ofVec3f(1, 1, 1) : numCells);
+                historyGradientMode = gradientMode;
+                historyAdaptive = adaptive;
+                historyDepth = adaptiveDepth;
+            }
+            octree.setMaxLeaves(adaptiveMaxLeaves);
+            if(spaceTime.getMaxFrames() != numScanFrames) spaceTime.setMaxFrames(numScanFrames);
+        }
+        
+        //--------------------------------------------------------------
+        // ingest: convert one band of image rows into the matching band of builder
+        void runTask(int band) {
+            const DepthFrame &frame = *ingestFrame;
+            const IngestSettings &s = ingestSettings;
+            int numBands = builder.getNumBands();
+            int step = s.pixelStep;
+            int jBegin = band * frame.height / numBands;
+            int jEnd = (band + 1) * frame.height / numBands;
+            jBegin = (jBegin + step - 1) / step * step;  // stay on the pixelStep grid
+            
+            PointBand &points = builder.getBand(band);
+            points.clear();
+            const unsigned char *rgb = &frame.rgb[0];
+            if(frame.hasDepth()) {
+                // convert whole rows of raw depth at once, then pick up the colors of the valid pixels
+                DepthRow &row = depthRows[band];
+                row.x.resize(frame.width);
+                row.y.resize(frame.width);
+                row.z.resize(frame.width);
+                row.valid.resize(frame.width);
+                for(int j=jBegin; j<jEnd; j += step) {
+                    if(depthToWorld.convertRow(j, &frame.depth[j * frame.width], step, s.nearThreshold, s.farThreshold, &row.x[0], &row.y[0], &row.z[0], &row.valid[0]) == 0) continue;
+                    for(int i=0, o=0; i<frame.width; i += step, o++) {
+                        if(row.valid[o]) {
+                            const unsigned char *c = rgb + (j * frame.width + i) * 3;
+                            points.addPoint(ofVec3f(row.x[o], row.y[o], row.z[o]), ofFloatColor(c[0] / 255.0f, c[1] / 255.0f, c[2] / 255.0f));
+                        }
+                    }
+                }
+            } else {
+                // if kinect isn't available, just use webcam for testing (use brightness for depth value)
+                for(int j=jBegin; j<jEnd; j += step) {
+                    for(int i=0; i<frame.width; i += step) {
+                        const unsigned char *pc = rgb + (j * frame.width + i) * 3;
+                        ofFloatColor c(pc[0] / 255.0f, pc[1] / 255.0f, pc[2] / 255.0f);
+                        ofVec3f p;
+                        p.x = ofMap(i, 0, frame.width, s.boundaryMin.x, s.boundaryMax.x);
+                        p.y = ofMap(j, 0, frame.height, s.boundaryMin.y, s.boundaryMax.y);
+                        p.z = ofMap(c.getBrightness(), 1, 0, s.webcamNear, s.webcamFar);
+                        if(ofInRange(p.z, s.nearThreshold, s.farThreshold)) {
+                            points.addPoint(p, c);
+                        }
+                    }
+                }
+            }
+        }
+    };
+}
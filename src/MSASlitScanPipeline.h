@@ -0,0 +1,259 @@
+#pragma once
+
+#include "ofMain.h"
+#include "Poco/Condition.h"
+#include "MSASlitScan.h"
+#include "MSAFrameQueue.h"
+#include "MSATripleBuffer.h"
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // runs a SlitScan as a pipeline of stages on their own threads:
+    // capture (caller, pushFrame) -> frame queue -> ingest thread -> compose thread -> triple buffered output mesh (caller, update / getMesh)
+    // each stage only waits for input, and ingest and compose run on worker threads of their own (see SlitScan::setup),
+    // so with enough cores throughput is bound by the slowest stage rather than the sum of all stages
+    class SlitScanPipeline {
+    public:
+        
+        //--------------------------------------------------------------
+        SlitScanPipeline() {
+            slitScan = NULL;
+            doSlitScan = true;
+            stopping = false;
+            ingestThread.pipeline = this;
+            composeThread.pipeline = this;
+        }
+        
+        //--------------------------------------------------------------
+        ~SlitScanPipeline() {
+            stop();
+        }
+        
+        //--------------------------------------------------------------
+        // start ingest and compose threads running slitScan, with up to queueCapacity captured frames waiting for ingest
+        void setup(SlitScan &slitScan, int queueCapacity = 4) {
+            stop();
+            this->slitScan = &slitScan;
+            stopping = false;
+            frames.setCapacity(queueCapacity);
+            ingestThread.startThread(false, false);
+            composeThread.startThread(false, false);
+        }
+        
+        //--------------------------------------------------------------
+        // stop and join all threads, frames still in flight are dropped
+        void stop() {
+            if(slitScan == NULL) return;
+            
+            frames.close();
+            
+            spacesMutex.lock();
+            stopping = true;
+            spacesAvailable.broadcast();
+            spacesMutex.unlock();
+            
+            ingestThread.waitForThread(true);
+            composeThread.waitForThread(true);
+            
+            for(int i=0; i<pendingSpaces.size(); i++) {
+                slitScan->recycleSpace(pendingSpaces[i].space);
+                if(pendingSpaces[i].frame) freeFrames.push_back(pendingSpaces[i].frame);
+            }
+            pendingSpaces.clear();
+            for(int i=0; i<freeFrames.size(); i++) delete freeFrames[i];
+            freeFrames.clear();
+            slitScan = NULL;
+        }
+        
+        //--------------------------------------------------------------
+        // slitscan (true) or just show the most recent frame (false)
+        void setSlitScan(bool b) {
+            doSlitScan = b;
+        }
+        
+        //--------------------------------------------------------------
+        // capture stage: queue a new frame for the ingest thread (swaps it out of frame, which gets back a recycled buffer)
+        // what happens when the ingest thread falls behind depends on the queue's drop policy
+        // returns false if the frame was dropped
+        bool pushFrame(DepthFrame &frame) {
+            captured.frame.swap(frame);
+            captured.doSlitScan = doSlitScan;
+            bool queued = frames.push(captured);
+            captured.frame.swap(frame);
+            return queued;
+        }
+        
+        //--------------------------------------------------------------
+        // pick up the newest composed mesh, returns true if there is a new one
+        bool update() {
+            return output.update();
+        }
+        
+        //--------------------------------------------------------------
+        // most recent composed mesh, valid until the next update()
+        ofMesh& getMesh() {
+            return output.getReadBuffer();
+        }
+        
+        //--------------------------------------------------------------
+        // what to do with captured frames when the ingest thread falls behind
+        void setDropPolicy(FrameDropPolicy policy) {
+            frames.setDropPolicy(policy);
+        }
+        
+        //--------------------------------------------------------------
+        // number of captured frames queued, dropped, and the most that were waiting at once
+        unsigned long getNumFramesQueued() {
+            return frames.getNumEnqueued();
+        }
+        
+        unsigned long getNumFramesDropped() {
+            return frames.getNumDropped();
+        }
+        
+        int getQueueHighWaterMark() {
+            return frames.getHighWaterMark();
+        }
+    
+    protected:
+        
+        //--------------------------------------------------------------
+        class StageThread : public ofThread {
+        public:
+            SlitScanPipeline *pipeline;
+        };
+        
+        class IngestThread : public StageThread {
+            void threadedFunction() {
+                pipeline->ingestLoop();
+            }
+        } ingestThread;
+        
+        class ComposeThread : public StageThread {
+            void threadedFunction() {
+                pipeline->composeLoop();
+            }
+        } composeThread;
+        
+        // a captured frame on its way to the ingest thread
+        struct CapturedFrame {
+            DepthFrame frame;
+            bool doSlitScan;
+            
+            CapturedFrame() {
+                doSlitScan = true;
+            }
+            
+            void swap(CapturedFrame &other) {
+                frame.swap(other.frame);
+                std::swap(doSlitScan, other.doSlitScan);
+            }
+        };
+        
+        // a binned frame on its way to the compose thread, or with a raw history (SlitScan::setRawHistory) the frame itself
+        struct PendingSpace {
+            PointSpace *space;
+            DepthFrame *frame;
+            bool doSlitScan;
+            int frameNum;
+        };
+        
+        SlitScan *slitScan;
+        bool doSlitScan;            // only touched by the capture side
+        
+        // capture -> ingest
+        FrameQueue<CapturedFrame> frames;
+        CapturedFrame captured;     // only touched by the capture side
+        
+        // ingest -> compose
+        bool stopping;
+        ofMutex spacesMutex;
+        Poco::Condition spacesAvailable;
+        vector<PendingSpace> pendingSpaces;
+        vector<DepthFrame*> freeFrames;         // frames handed back by the compose thread, so their buffers get reused
+        
+        // compose -> caller
+        TripleBuffer<ofMesh> output;
+        
+        //--------------------------------------------------------------
+        void ingestLoop() {
+            Tracer *tracer = slitScan->getTracer();
+            if(tracer) tracer->setThreadName("ingest");
+            
+            CapturedFrame captured;
+            while(frames.waitPop(captured)) {
+                ScopedTrace trace(tracer, "ingest", captured.frame.frameNum);
+                PendingSpace pending;
+                pending.space = NULL;
+                pending.frame = NULL;
+                pending.doSlitScan = captured.doSlitScan;
+                pending.frameNum = captured.frame.frameNum;
+                
+                // a raw history bins at composition time, so frames to slitscan only change hands here
+                bool raw = captured.doSlitScan && slitScan->getRawHistory();
+                if(!raw) pending.space = slitScan->ingest(captured.frame);
+                
+                spacesMutex.lock();
+                if(raw) {
+                    if(freeFrames.empty()) {
+                        pending.frame = new DepthFrame;
+                    } else {
+                        pending.frame = freeFrames.back();
+                        freeFrames.pop_back();
+                    }
+                    pending.frame->swap(captured.frame);
+                }
+                pendingSpaces.push_back(pending);
+                spacesAvailable.signal();
+                spacesMutex.unlock();
+            }
+        }
+        
+        //--------------------------------------------------------------
+        void composeLoop() {
+            Tracer *tracer = slitScan->getTracer();
+            if(tracer) tracer->setThreadName("compose");
+            
+            vector<PendingSpace> spaces;
+            while(true) {
+                spacesMutex.lock();
+                while(pendingSpaces.empty() && !stopping) spacesAvailable.wait(spacesMutex);
+                if(stopping) {
+                    spacesMutex.unlock();
+                    break;
+                }
+                spaces.swap(pendingSpaces);
+                spacesMutex.unlock();
+                
+                // add everything that arrived since the last composition, but only compose once
+                ofMesh &mesh = output.getWriteBuffer();
+                PendingSpace &newest = spaces.back();
+                ScopedTrace trace(tracer, "compose pass", newest.frameNum);
+                if(newest.doSlitScan) {
+                    for(int i=0; i<spaces.size(); i++) {
+                        if(spaces[i].frame) slitScan->addFrame(*spaces[i].frame);
+                        else if(spaces[i].doSlitScan) slitScan->addSpace(spaces[i].space);
+                        else slitScan->recycleSpace(spaces[i].space);
+                    }
+                    slitScan->compose(mesh.getVertices(), mesh.getColors());
+                } else {
+                    slitScan->getPoints(newest.space, mesh.getVertices(), mesh.getColors());
+                    for(int i=0; i<spaces.size(); i++) {
+                        if(spaces[i].frame) slitScan->addFrame(*spaces[i].frame);
+                        else slitScan->recycleSpace(spaces[i].space);
+                    }
+                }
+                trace.setPoints(mesh.getNumVertices());
+                
+                spacesMutex.lock();
+                for(int i=0; i<spaces.size(); i++) if(spaces[i].frame) freeFrames.push_back(spaces[i].frame);
+                spacesMutex.unlock();
+                spaces.clear();
+                output.publish();
+            }
+        }
+    };
+}
@@ -1,20 +1,24 @@
 #pragma once
 
 #include "ofMain.h"
+#include "MSAThreadPool.h"
 
 namespace msa {
     
     //--------------------------------------------------------------
     //--------------------------------------------------------------
     //--------------------------------------------------------------
-    template <typename T>   // the type of data stored in each quantum cell
-    class SpaceT {
+    // quantized grid spanning a physical region of space
+    // cells are numbered x first, then y, then z, or in Morton (z-order) order, where every octree node is a contiguous range of cells
+    class SpaceGrid {
     public:
         
         //--------------------------------------------------------------
-        SpaceT(ofVec3f numCells, ofVec3f bmin, ofVec3f bmax) {
-            setNumCells(numCells);
-            setBoundaries(bmin, bmax);
+        SpaceGrid() {
+            mortonOrder = false;
+            boundaryMin.set(0);
+            boundaryMax.set(1);
+            setNumCells(ofVec3f(1, 1, 1));
         }
         
         //--------------------------------------------------------------
@@ -23,12 +27,55 @@ namespace msa {
             return numCells;
         }
         
+        //--------------------------------------------------------------
+        // get total number of quantum cells
+        int getNumCellsTotal() {
+            return strideZ * cellsZ;
+        }
+        
         //--------------------------------------------------------------
         // set number of quantum cells on each axis
         void setNumCells(ofVec3f numCells) {
             this->numCells = numCells;
+            cellsX = max(1, (int)numCells.x);
+            cellsY = max(1, (int)numCells.y);
+            cellsZ = max(1, (int)numCells.z);
+            strideY = cellsX;
+            strideZ = cellsX * cellsY;
+            updateMapping();
             
-            data.resize(numCells.x * numCells.y * numCells.z);
+            // pick the binning kernel specialized for the axes which have more than one cell
+            int axes = (cellsX > 1 ? 1 : 0) | (cellsY > 1 ? 2 : 0) | (cellsZ > 1 ? 4 : 0);
+            if(mortonOrder) axes = 8;
+            switch(axes) {
+                case 8: indicesFunc = &SpaceGrid::mortonIndicesForPositions; break;
+                case 0: indicesFunc = &SpaceGrid::cellIndicesForPositionsT<false, false, false>; break;
+                case 1: indicesFunc = &SpaceGrid::cellIndicesForPositionsT<true,  false, false>; break;
+                case 2: indicesFunc = &SpaceGrid::cellIndicesForPositionsT<false, true,  false>; break;
+                case 3: indicesFunc = &SpaceGrid::cellIndicesForPositionsT<true,  true,  false>; break;
+                case 4: indicesFunc = &SpaceGrid::cellIndicesForPositionsT<false, false, true>;  break;
+                case 5: indicesFunc = &SpaceGrid::cellIndicesForPositionsT<true,  false, true>;  break;
+                case 6: indicesFunc = &SpaceGrid::cellIndicesForPositionsT<false, true,  true>;  break;
+                default: indicesFunc = &SpaceGrid::cellIndicesForPositionsT<true, true,  true>;  break;
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // number cells in Morton order, the number of cells must be the same power of two on all axes (up to 1024)
+        void setMortonOrder(bool b) {
+            mortonOrder = b;
+            setNumCells(numCells);
+        }
+        
+        //--------------------------------------------------------------
+        bool getMortonOrder() {
+            return mortonOrder;
+        }
+        
+        //--------------------------------------------------------------
+        // Morton code of quantum index (i, j, k), i.e. their bits interleaved
+        static unsigned int getMortonCode(unsigned int i, unsigned int j, unsigned int k) {
+            return spreadBits(i) | (spreadBits(j) << 1) | (spreadBits(k) << 2);
         }
         
         //--------------------------------------------------------------
@@ -36,19 +83,161 @@ namespace msa {
         void setBoundaries(ofVec3f bmin, ofVec3f bmax) {
             boundaryMin = bmin;
             boundaryMax = bmax;
+            updateMapping();
         }
         
         
         //--------------------------------------------------------------
         // get quantum index given a physical world position
         ofVec3f getIndexForPosition(ofVec3f p) {
-            ofVec3f v;
-            v.x = ofMap(p.x, boundaryMin.x, boundaryMax.x, 0, numCells.x-1, true);
-            v.y = ofMap(p.y, boundaryMin.y, boundaryMax.y, 0, numCells.y-1, true);
-            v.z = ofMap(p.z, boundaryMin.z, boundaryMax.z, 0, numCells.z-1, true);
+            return ofVec3f(axisIndex(p.x, 0, cellsX), axisIndex(p.y, 1, cellsY), axisIndex(p.z, 2, cellsZ));
+        }
+        
+        //--------------------------------------------------------------
+        // get linear cell index given a physical world position
+        unsigned int cellIndexForPosition(const ofVec3f &p) {
+            if(mortonOrder) return getMortonCode(axisIndex(p.x, 0, cellsX), axisIndex(p.y, 1, cellsY), axisIndex(p.z, 2, cellsZ));
+            return axisIndex(p.z, 2, cellsZ) * strideZ + axisIndex(p.y, 1, cellsY) * strideY + axisIndex(p.x, 0, cellsX);
+        }
+        
+        //--------------------------------------------------------------
+        // get linear cell indices for an array of physical world positions
+        // only maps the axes which have more than one cell (e.g. just x for a 500x1x1 grid)
+        void cellIndicesForPositions(const ofVec3f *p, unsigned int *outIndices, int numPositions) {
+            (this->*indicesFunc)(p, outIndices, numPositions);
+        }
+        
+        
+        //--------------------------------------------------------------
+        // get linear cell index for given quantum index
+        int getCellIndex(ofVec3f index) {
+            return getCellIndex(index.x, index.y, index.z);
+        }
+        
+        //--------------------------------------------------------------
+        // get linear cell index for given quantum index
+        int getCellIndex(int i, int j, int k) {
+            if(mortonOrder) return getMortonCode(i, j, k);
+            return k * strideZ + j * strideY + i;
+        }
+        
+        //--------------------------------------------------------------
+        // get physical range of the positions mapped to quantum indices [iBegin, iEnd] on axis (0-2), for boundaryMin < boundaryMax
+        // unbounded (-FLT_MAX / FLT_MAX) at the first and last cell, since positions beyond the boundaries are clamped onto them
+        void getAxisRange(int axis, int iBegin, int iEnd, float &pMin, float &pMax) {
+            int cells = axis == 0 ? cellsX : (axis == 1 ? cellsY : cellsZ);
+            pMin = iBegin <= 0 || scale[axis] == 0 ? -FLT_MAX : (iBegin - bias[axis]) / scale[axis];
+            pMax = iEnd >= cells - 1 || scale[axis] == 0 ? FLT_MAX : (iEnd + 1 - bias[axis]) / scale[axis];
+        }
+        
+    protected:
+        bool mortonOrder;
+        ofVec3f numCells;
+        ofVec3f boundaryMin, boundaryMax;
+        
+        // integer extents and per axis mapping: index = clamp(int(p * scale + bias), 0, cells-1)
+        int cellsX, cellsY, cellsZ;
+        int strideY, strideZ;
+        float scale[3], bias[3];
+        
+        typedef void (SpaceGrid::*IndicesFunc)(const ofVec3f*, unsigned int*, int);
+        IndicesFunc indicesFunc;
+        
+        //--------------------------------------------------------------
+        template <bool useX, bool useY, bool useZ>
+        void cellIndicesForPositionsT(const ofVec3f *p, unsigned int *outIndices, int numPositions) {
+            for(int n=0; n<numPositions; n++) {
+                unsigned int c = 0;
+                if(useX) c += axisIndex(p[n].x, 0, cellsX);
+                if(useY) c += axisIndex(p[n].y, 1, cellsY) * strideY;
+                if(useZ) c += axisIndex(p[n].z, 2, cellsZ) * strideZ;
+                outIndices[n] = c;
+            }
+        }
+        
+        //--------------------------------------------------------------
+        void mortonIndicesForPositions(const ofVec3f *p, unsigned int *outIndices, int numPositions) {
+            for(int n=0; n<numPositions; n++) {
+                outIndices[n] = getMortonCode(axisIndex(p[n].x, 0, cellsX), axisIndex(p[n].y, 1, cellsY), axisIndex(p[n].z, 2, cellsZ));
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // spread the low 10 bits of v two bits apart
+        static unsigned int spreadBits(unsigned int v) {
+            v &= 0x3ff;
+            v = (v | (v << 16)) & 0x030000ff;
+            v = (v | (v << 8)) & 0x0300f00f;
+            v = (v | (v << 4)) & 0x030c30c3;
+            v = (v | (v << 2)) & 0x09249249;
             return v;
         }
         
+        //--------------------------------------------------------------
+        void updateMapping() {
+            int cells[3] = { cellsX, cellsY, cellsZ };
+            for(int a=0; a<3; a++) {
+                float size = boundaryMax[a] - boundaryMin[a];
+                scale[a] = fabs(size) > FLT_EPSILON ? (cells[a] - 1) / size : 0;
+                bias[a] = -boundaryMin[a] * scale[a];
+            }
+        }
+        
+        //--------------------------------------------------------------
+        int axisIndex(float p, int a, int cells) {
+            float v = p * scale[a] + bias[a];
+            if(v <= 0) return 0;
+            int i = (int)v;
+            return i < cells ? i : cells - 1;
+        }
+    };
+    
+    
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // how a Space stores its cells and points (see PointSpace::setCompact, PointSpace::setSparse and SpaceGrid::setMortonOrder)
+    // given to a Space together with its number of cells, so storage is only ever allocated for the format in use
+    struct SpaceFormat {
+        bool compact;
+        bool sparse;
+        bool mortonOrder;
+        
+        SpaceFormat(bool compact = false, bool sparse = false, bool mortonOrder = false) : compact(compact), sparse(sparse), mortonOrder(mortonOrder) {}
+    };
+    
+    
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    template <typename T>   // the type of data stored in each quantum cell
+    class SpaceT : public SpaceGrid {
+    public:
+        
+        //--------------------------------------------------------------
+        // only the Morton order of format applies, every cell holds one T
+        SpaceT(ofVec3f numCells, ofVec3f bmin, ofVec3f bmax, const SpaceFormat &format = SpaceFormat()) {
+            setFormat(numCells, format);
+            setBoundaries(bmin, bmax);
+        }
+        
+        //--------------------------------------------------------------
+        // set number of quantum cells on each axis
+        void setNumCells(ofVec3f numCells) {
+            SpaceGrid::setNumCells(numCells);
+            
+            data.resize(getNumCellsTotal());
+        }
+        
+        //--------------------------------------------------------------
+        // set number of quantum cells on each axis and their order
+        void setFormat(ofVec3f numCells, const SpaceFormat &format) {
+            mortonOrder = format.mortonOrder;
+            setNumCells(numCells);
+        }
+        
         
         //--------------------------------------------------------------
         // get quantum data for given quantum index
@@ -60,12 +249,10 @@ namespace msa {
         //--------------------------------------------------------------
         // get quantum data for given quantum index
         T& getDataAtIndex(int i, int j, int k) {
-            return data[k * numCells.x * numCells.y + j * numCells.x + i];
+            return data[getCellIndex(i, j, k)];
         }
         
     protected:
-        ofVec3f numCells;
-        ofVec3f boundaryMin, boundaryMax;
         vector<T> data;
         
     };
@@ -75,56 +262,963 @@ namespace msa {
     //--------------------------------------------------------------
     //--------------------------------------------------------------
     //--------------------------------------------------------------
-    template <typename T>
+    // point quantized against the bounds of the points stored in its Space, 10 bytes instead of 28
+    struct CompactPoint {
+        unsigned short x, y, z;
+        unsigned char r, g, b, a;
+    };
+    
+    
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // all points of a frame in one contiguous position and color array, sorted by cell
+    // cell c owns points [cellOffsets[c], cellOffsets[c+1])
+    // in compact mode points are stored as CompactPoints and decoded when copied out
+    // in sparse mode only occupied cells have offsets: slot s of the sorted occupiedCells owns [cellOffsets[s], cellOffsets[s+1]),
+    // and a cell's slot is found through an occupancy bitmap with the number of occupied cells before each word
+    // (or by binary search in Morton order, for fine grids which are queried by ranges of cells rather than single cells)
+    class PointSpace : public SpaceGrid {
+    public:
+        
+        //--------------------------------------------------------------
+        PointSpace(ofVec3f numCells, ofVec3f bmin, ofVec3f bmax, const SpaceFormat &format = SpaceFormat()) {
+            compact = false;
+            sparse = false;
+            setFormat(numCells, format);
+            setBoundaries(bmin, bmax);
+        }
+        
+        //--------------------------------------------------------------
+        // set number of quantum cells on each axis (discards all points)
+        void setNumCells(ofVec3f numCells) {
+            setFormat(numCells, getFormat());
+        }
+        
+        //--------------------------------------------------------------
+        // set number of quantum cells on each axis and how they and their points are stored (discards all points)
+        // the format is applied before the cells are allocated, so e.g. a fine sparse grid never allocates offsets for every cell
+        void setFormat(ofVec3f numCells, const SpaceFormat &format) {
+            // release storage of the other format
+            if(format.compact != compact) {
+                vector<ofVec3f>().swap(vertices);
+                vector<ofFloatColor>().swap(colors);
+                vector<CompactPoint>().swap(compactPoints);
+            }
+            if(format.sparse != sparse || format.mortonOrder != mortonOrder) {
+                vector<unsigned int>().swap(cellOffsets);
+                vector<unsigned int>().swap(occupiedCells);
+                vector<unsigned long long>().swap(occupancy);
+                vector<unsigned int>().swap(occupancyRanks);
+            }
+            
+            compact = format.compact;
+            sparse = format.sparse;
+            mortonOrder = format.mortonOrder;
+            SpaceGrid::setNumCells(numCells);
+            clear();
+        }
+        
+        //--------------------------------------------------------------
+        SpaceFormat getFormat() {
+            return SpaceFormat(compact, sparse, mortonOrder);
+        }
+        
+        //--------------------------------------------------------------
+        // number cells in Morton order (discards all points)
+        void setMortonOrder(bool b) {
+            if(b == mortonOrder) return;
+            SpaceFormat format = getFormat();
+            format.mortonOrder = b;
+            setFormat(getNumCells(), format);
+        }
+        
+        //--------------------------------------------------------------
+        // store points quantized to CompactPoints (discards all points)
+        // positions are quantized against the bounds of the frame's own points rather than the boundaries,
+        // so points beyond the boundaries (which are only binned into the outer cells) keep their positions
+        void setCompact(bool b) {
+            if(b == compact) return;
+            SpaceFormat format = getFormat();
+            format.compact = b;
+            setFormat(getNumCells(), format);
+        }
+        
+        //--------------------------------------------------------------
+        bool getCompact() {
+            return compact;
+        }
+        
+        //--------------------------------------------------------------
+        // store only occupied cells (discards all points), so memory grows with the occupied cells rather than the grid
+        // (about 1 bit per cell plus 8 bytes per occupied cell, instead of 4 bytes per cell)
+        void setSparse(bool b) {
+            if(b == sparse) return;
+            SpaceFormat format = getFormat();
+            format.sparse = b;
+            setFormat(getNumCells(), format);
+        }
+        
+        //--------------------------------------------------------------
+        bool getSparse() {
+            return sparse;
+        }
+        
+        //--------------------------------------------------------------
+        // remove all points
+        void clear() {
+            vertices.clear();
+            colors.clear();
+            compactPoints.clear();
+            pointMin.set(0);
+            pointMax.set(0);
+            if(sparse) {
+                occupiedCells.clear();
+                cellOffsets.assign(1, 0);
+                if(!mortonOrder) {
+                    occupancy.assign((getNumCellsTotal() + 63) / 64, 0);
+                    occupancyRanks.assign(occupancy.size(), 0);
+                }
+            } else {
+                cellOffsets.assign(getNumCellsTotal() + 1, 0);
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // get total number of points in all cells
+        int getNumPoints() {
+            return cellOffsets.back();
+        }
+        
+        //--------------------------------------------------------------
+        // get number of points in given cell
+        int getCellNumPoints(int cell) {
+            int slot = getCellSlot(cell);
+            return slot < 0 ? 0 : cellOffsets[slot + 1] - cellOffsets[slot];
+        }
+        
+        //--------------------------------------------------------------
+        // copy (and decode if compact) all points of given cell into getCellNumPoints(cell) sized arrays
+        void copyCellPoints(int cell, ofVec3f *outVertices, ofFloatColor *outColors) {
+            int slot = getCellSlot(cell);
+            if(slot >= 0) copySlotPoints(slot, slot + 1, outVertices, outColors);
+        }
+        
+        //--------------------------------------------------------------
+        // copy (and decode if compact) the points of all cells into getNumPoints() sized arrays
+        void copyPoints(ofVec3f *outVertices, ofFloatColor *outColors) {
+            copySlotPoints(0, cellOffsets.size() - 1, outVertices, outColors);
+        }
+        
+        //--------------------------------------------------------------
+        // get number of points in cells [cellBegin, cellEnd), e.g. an octree node in Morton order
+        int getRangeNumPoints(unsigned int cellBegin, unsigned int cellEnd) {
+            int slotBegin, slotEnd;
+            getRangeSlots(cellBegin, cellEnd, slotBegin, slotEnd);
+            return cellOffsets[slotEnd] - cellOffsets[slotBegin];
+        }
+        
+        //--------------------------------------------------------------
+        // copy (and decode if compact) all points of cells [cellBegin, cellEnd) into getRangeNumPoints sized arrays
+        void copyRangePoints(unsigned int cellBegin, unsigned int cellEnd, ofVec3f *outVertices, ofFloatColor *outColors) {
+            int slotBegin, slotEnd;
+            getRangeSlots(cellBegin, cellEnd, slotBegin, slotEnd);
+            copySlotPoints(slotBegin, slotEnd, outVertices, outColors);
+        }
+        
+        //--------------------------------------------------------------
+        // points are stored in slots, one per cell (or per occupied cell in sparse mode) in cell order
+        // slots [slotBegin, slotEnd) hold getSlotOffset(slotEnd) - getSlotOffset(slotBegin) points
+        // get first slot of a cell at or after cell, searching only slots [slotBegin, slotEnd) (e.g. the slots of an enclosing range)
+        int getSlotBound(unsigned int cell, int slotBegin, int slotEnd) {
+            if(!sparse) return max(slotBegin, min((int)min(cell, 0x7fffffffu), slotEnd));
+            return std::lower_bound(occupiedCells.begin() + slotBegin, occupiedCells.begin() + slotEnd, cell) - occupiedCells.begin();
+        }
+        
+        //--------------------------------------------------------------
+        unsigned int getSlotOffset(int slot) {
+            return cellOffsets[slot];
+        }
+        
+        //--------------------------------------------------------------
+        int getNumSlots() {
+            return cellOffsets.size() - 1;
+        }
+        
+        //--------------------------------------------------------------
+        // get number of cells holding points (in sparse mode), or of all cells
+        int getNumOccupiedCells() {
+            return sparse ? occupiedCells.size() : getNumCellsTotal();
+        }
+        
+        //--------------------------------------------------------------
+        // get bounds of the stored points (in compact mode, zero otherwise)
+        ofVec3f getPointMin() {
+            return pointMin;
+        }
+        
+        ofVec3f getPointMax() {
+            return pointMax;
+        }
+        
+        //--------------------------------------------------------------
+        // get number of bytes allocated by this Space (including unused capacity)
+        size_t getBytesReserved() {
+            return vertices.capacity() * sizeof(ofVec3f)
+            + colors.capacity() * sizeof(ofFloatColor)
+            + compactPoints.capacity() * sizeof(CompactPoint)
+            + cellOffsets.capacity() * sizeof(unsigned int)
+            + occupiedCells.capacity() * sizeof(unsigned int)
+            + occupancy.capacity() * sizeof(unsigned long long)
+            + occupancyRanks.capacity() * sizeof(unsigned int);
+        }
+        
+    protected:
+        bool compact;
+        bool sparse;
+        vector<ofVec3f> vertices;
+        vector<ofFloatColor> colors;
+        vector<CompactPoint> compactPoints;
+        vector<unsigned int> cellOffsets;           // per cell, or per occupied cell in sparse mode (plus one for the end)
+        vector<unsigned int> occupiedCells;         // sparse mode: sorted cells holding points
+        vector<unsigned long long> occupancy;       // sparse mode: bit per cell, set if it holds points
+        vector<unsigned int> occupancyRanks;        // sparse mode: number of occupied cells before each word of occupancy
+        ofVec3f pointMin, pointMax;                 // compact mode: bounds of the stored points, what they're quantized against
+        
+        friend class PointSpaceBuilder;
+        
+        //--------------------------------------------------------------
+        // index of cell in cellOffsets (the cell itself unless sparse), -1 if the cell is empty in sparse mode
+        int getCellSlot(int cell) {
+            if(!sparse) return cell;
+            if(mortonOrder) {
+                vector<unsigned int>::iterator it = std::lower_bound(occupiedCells.begin(), occupiedCells.end(), (unsigned int)cell);
+                return it != occupiedCells.end() && *it == cell ? it - occupiedCells.begin() : -1;
+            }
+            unsigned long long word = occupancy[cell >> 6];
+            unsigned long long bit = 1ULL << (cell & 63);
+            if((word & bit) == 0) return -1;
+            return occupancyRanks[cell >> 6] + __builtin_popcountll(word & (bit - 1));
+        }
+        
+        //--------------------------------------------------------------
+        // slots [slotBegin, slotEnd) holding the points of cells [cellBegin, cellEnd)
+        void getRangeSlots(unsigned int cellBegin, unsigned int cellEnd, int &slotBegin, int &slotEnd) {
+            if(sparse) {
+                slotBegin = std::lower_bound(occupiedCells.begin(), occupiedCells.end(), cellBegin) - occupiedCells.begin();
+                slotEnd = std::lower_bound(occupiedCells.begin() + slotBegin, occupiedCells.end(), cellEnd) - occupiedCells.begin();
+            } else {
+                slotBegin = min(cellBegin, (unsigned int)getNumCellsTotal());
+                slotEnd = min(cellEnd, (unsigned int)getNumCellsTotal());
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // sparse mode: build occupancy bitmap and ranks from occupiedCells (not used in Morton order)
+        void updateOccupancy() {
+            if(mortonOrder) return;
+            std::fill(occupancy.begin(), occupancy.end(), 0);
+            for(int s=0; s<occupiedCells.size(); s++) {
+                occupancy[occupiedCells[s] >> 6] |= 1ULL << (occupiedCells[s] & 63);
+            }
+            unsigned int rank = 0;
+            for(int w=0; w<occupancy.size(); w++) {
+                occupancyRanks[w] = rank;
+                rank += __builtin_popcountll(occupancy[w]);
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // copy the points of slots [slotBegin, slotEnd), which are contiguous
+        void copySlotPoints(int slotBegin, int slotEnd, ofVec3f *outVertices, ofFloatColor *outColors) {
+            unsigned int begin = cellOffsets[slotBegin];
+            unsigned int end = cellOffsets[slotEnd];
+            if(compact) {
+                ofVec3f step = getDequantizeStep();
+                for(unsigned int i=begin; i<end; i++) {
+                    decode(compactPoints[i], step, *outVertices++, *outColors++);
+                }
+            } else if(end > begin) {
+                memcpy(outVertices, &vertices[begin], (end - begin) * sizeof(ofVec3f));
+                memcpy(outColors, &colors[begin], (end - begin) * sizeof(ofFloatColor));
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // size storage for numPoints points
+        void resizePoints(int numPoints) {
+            if(compact) {
+                compactPoints.resize(numPoints);
+            } else {
+                vertices.resize(numPoints);
+                colors.resize(numPoints);
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // write points into their cells, cellCursors holds the next free slot in each cell
+        void storePoints(const ofVec3f *positions, const ofFloatColor *colors, const unsigned int *cells, int numPoints, unsigned int *cellCursors) {
+            if(compact) {
+                ofVec3f scale = getQuantizeScale();
+                for(int i=0; i<numPoints; i++) {
+                    unsigned int dst = cellCursors[cells[i]]++;
+                    compactPoints[dst] = encode(positions[i], colors[i], scale);
+                }
+            } else {
+                for(int i=0; i<numPoints; i++) {
+                    unsigned int dst = cellCursors[cells[i]]++;
+                    vertices[dst] = positions[i];
+                    this->colors[dst] = colors[i];
+                }
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // write point i to slot dsts[i]
+        void storePointsAt(const ofVec3f *positions, const ofFloatColor *colors, const unsigned int *dsts, int numPoints) {
+            if(compact) {
+                ofVec3f scale = getQuantizeScale();
+                for(int i=0; i<numPoints; i++) compactPoints[dsts[i]] = encode(positions[i], colors[i], scale);
+            } else {
+                for(int i=0; i<numPoints; i++) {
+                    vertices[dsts[i]] = positions[i];
+                    this->colors[dsts[i]] = colors[i];
+                }
+            }
+        }
+        
+        //--------------------------------------------------------------
+        ofVec3f getQuantizeScale() {
+            ofVec3f size = pointMax - pointMin;
+            return ofVec3f(size.x > 0 ? 65535.0f / size.x : 0, size.y > 0 ? 65535.0f / size.y : 0, size.z > 0 ? 65535.0f / size.z : 0);
+        }
+        
+        //--------------------------------------------------------------
+        ofVec3f getDequantizeStep() {
+            ofVec3f size = pointMax - pointMin;
+            return ofVec3f(size.x / 65535.0f, size.y / 65535.0f, size.z / 65535.0f);
+        }
+        
+        //--------------------------------------------------------------
+        CompactPoint encode(const ofVec3f &p, const ofFloatColor &c, const ofVec3f &scale) {
+            CompactPoint q;
+            q.x = ofClamp((p.x - pointMin.x) * scale.x + 0.5f, 0, 65535);
+            q.y = ofClamp((p.y - pointMin.y) * scale.y + 0.5f, 0, 65535);
+            q.z = ofClamp((p.z - pointMin.z) * scale.z + 0.5f, 0, 65535);
+            q.r = ofClamp(c.r * 255.0f + 0.5f, 0, 255);
+            q.g = ofClamp(c.g * 255.0f + 0.5f, 0, 255);
+            q.b = ofClamp(c.b * 255.0f + 0.5f, 0, 255);
+            q.a = ofClamp(c.a * 255.0f + 0.5f, 0, 255);
+            return q;
+        }
+        
+        //--------------------------------------------------------------
+        void decode(const CompactPoint &q, const ofVec3f &step, ofVec3f &p, ofFloatColor &c) {
+            p.x = pointMin.x + q.x * step.x;
+            p.y = pointMin.y + q.y * step.y;
+            p.z = pointMin.z + q.z * step.z;
+            c.r = q.r / 255.0f;
+            c.g = q.g / 255.0f;
+            c.b = q.b / 255.0f;
+            c.a = q.a / 255.0f;
+        }
+    };
+    
+    
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // points of one band of the input (e.g. a range of image rows), filled by a single thread
+    class PointBand {
+    public:
+        
+        //--------------------------------------------------------------
+        void clear() {
+            positions.clear();
+            colors.clear();
+        }
+        
+        //--------------------------------------------------------------
+        void addPoint(const ofVec3f &p, const ofFloatColor &c) {
+            positions.push_back(p);
+            colors.push_back(c);
+        }
+        
+        //--------------------------------------------------------------
+        int getNumPoints() {
+            return positions.size();
+        }
+        
+    protected:
+        friend class PointSpaceBuilder;
+        
+        vector<ofVec3f> positions;
+        vector<ofFloatColor> colors;
+        ofVec3f pointMin, pointMax;         // bounds of the points (for compact spaces)
+        vector<unsigned int> cells;         // cell of each point (sparse: then its write position)
+        vector<unsigned int> cellCursors;   // number of points in each cell, then next write position in each cell
+        
+        // sparse spaces
+        vector<unsigned long long> keys;    // (cell << 32) | point, sorted
+        vector<unsigned long long> sortTemp;
+        vector<unsigned int> runCells;      // cells the band has points in, sorted
+        vector<unsigned int> runStarts;     // number of points in each of runCells, then write position of the first
+    };
+    
+    
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // bins the points of all PointBands into a PointSpace with a parallel counting sort:
+    // every band counts its points per cell, a prefix sum over (cell, band) gives each band
+    // its own write range inside every cell, then all bands scatter their points without locks
+    // for sparse spaces every band sorts its points by cell instead, and only the cells the bands hit are merged,
+    // so nothing is proportional to the number of cells in the grid
+    class PointSpaceBuilder : protected ParallelJob {
+    public:
+        
+        //--------------------------------------------------------------
+        PointSpaceBuilder() {
+            space = NULL;
+            phase = 0;
+            setNumBands(1);
+        }
+        
+        //--------------------------------------------------------------
+        void setNumBands(int n) {
+            bands.resize(max(1, n));
+        }
+        
+        //--------------------------------------------------------------
+        int getNumBands() {
+            return bands.size();
+        }
+        
+        //--------------------------------------------------------------
+        PointBand& getBand(int b) {
+            return bands[b];
+        }
+        
+        //--------------------------------------------------------------
+        // remove points from all bands (keeps their capacity)
+        void clear() {
+            for(int b=0; b<bands.size(); b++) bands[b].clear();
+        }
+        
+        //--------------------------------------------------------------
+        // get total number of points in all bands
+        int getNumPoints() {
+            int n = 0;
+            for(int b=0; b<bands.size(); b++) n += bands[b].getNumPoints();
+            return n;
+        }
+        
+        //--------------------------------------------------------------
+        // replace the points of space with the points of all bands, runs bands on pool if given
+        void build(PointSpace &space, ThreadPool *pool = NULL) {
+            this->space = &space;
+            int numBands = bands.size();
+            
+            // pass 1: find cell of each point and count points per cell in every band (or sort them by cell for sparse spaces)
+            phase = 0;
+            if(pool) pool->run(*this, numBands);
+            else for(int b=0; b<numBands; b++) runTask(b);
+            
+            if(space.sparse) mergeRuns(space);
+            else prefixSumCells(space);
+            if(space.compact) mergePointBounds(space);
+            
+            // pass 2: scatter points of every band into their cells
+            phase = 1;
+            if(pool) pool->run(*this, numBands);
+            else for(int b=0; b<numBands; b++) runTask(b);
+            
+            this->space = NULL;
+        }
+        
+    protected:
+        vector<PointBand> bands;
+        PointSpace *space;
+        int phase;
+        vector<unsigned long long> mergeKeys;   // (cell << 32) | band of every run of every band
+        vector<unsigned int> bandRuns;          // next run of each band while merging
+        
+        //--------------------------------------------------------------
+        // stable sort of (cell << 32) | point keys by cell, in as few passes of up to 12 bits of the cell as it takes
+        // (e.g. 2 passes of 12 bits for the 2^24 cells of a 256 x 256 x 256 Morton grid)
+        static void radixSortByCell(vector<unsigned long long> &keys, vector<unsigned long long> &temp, int numCellsTotal) {
+            int cellBits = 1;
+            while(cellBits < 32 && (unsigned int)(numCellsTotal - 1) >> cellBits) cellBits++;
+            int numPasses = (cellBits + 11) / 12;
+            int digitBits = (cellBits + numPasses - 1) / numPasses;
+            int numDigits = 1 << digitBits;
+            unsigned int counts[1 << 12];
+            temp.resize(keys.size());
+            for(int shift=32; shift<32 + cellBits; shift += digitBits) {
+                memset(counts, 0, sizeof(counts));
+                for(int i=0; i<keys.size(); i++) counts[(keys[i] >> shift) & (numDigits - 1)]++;
+                unsigned int total = 0;
+                for(int d=0; d<numDigits; d++) {
+                    unsigned int count = counts[d];
+                    counts[d] = total;
+                    total += count;
+                }
+                for(int i=0; i<keys.size(); i++) temp[counts[(keys[i] >> shift) & (numDigits - 1)]++] = keys[i];
+                keys.swap(temp);
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // prefix sum (cell, band) counts into cell offsets and per band write cursors
+        void prefixSumCells(PointSpace &space) {
+            int numCellsTotal = space.getNumCellsTotal();
+            int numBands = bands.size();
+            vector<unsigned int> &cellOffsets = space.cellOffsets;
+            cellOffsets.resize(numCellsTotal + 1);
+            unsigned int total = 0;
+            for(int c=0; c<numCellsTotal; c++) {
+                cellOffsets[c] = total;
+                for(int b=0; b<numBands; b++) {
+                    unsigned int count = bands[b].cellCursors[c];
+                    bands[b].cellCursors[c] = total;
+                    total += count;
+                }
+            }
+            cellOffsets[numCellsTotal] = total;
+            space.resizePoints(total);
+        }
+        
+        //--------------------------------------------------------------
+        // sparse: merge the runs of all bands into the occupied cells and offsets of space, in (cell, band) order
+        // and turn every run's count into its write position
+        void mergeRuns(PointSpace &space) {
+            mergeKeys.clear();
+            for(int b=0; b<bands.size(); b++) {
+                for(int r=0; r<bands[b].runCells.size(); r++) mergeKeys.push_back((unsigned long long)bands[b].runCells[r] << 32 | b);
+            }
+            std::sort(mergeKeys.begin(), mergeKeys.end());
+            
+            bandRuns.assign(bands.size(), 0);
+            space.occupiedCells.clear();
+            space.cellOffsets.clear();
+            unsigned int total = 0;
+            for(int i=0; i<mergeKeys.size(); i++) {
+                unsigned int cell = mergeKeys[i] >> 32;
+                PointBand &band = bands[mergeKeys[i] & 0xffffffff];
+                if(space.occupiedCells.empty() || space.occupiedCells.back() != cell) {
+                    space.occupiedCells.push_back(cell);
+                    space.cellOffsets.push_back(total);
+                }
+                unsigned int &run = band.runStarts[bandRuns[mergeKeys[i] & 0xffffffff]++];
+                unsigned int count = run;
+                run = total;
+                total += count;
+            }
+            space.cellOffsets.push_back(total);
+            space.updateOccupancy();
+            space.resizePoints(total);
+        }
+        
+        //--------------------------------------------------------------
+        // compact: bounds of the points of all bands, for space to quantize against
+        void mergePointBounds(PointSpace &space) {
+            bool empty = true;
+            for(int b=0; b<bands.size(); b++) {
+                if(bands[b].positions.empty()) continue;
+                for(int a=0; a<3; a++) {
+                    space.pointMin[a] = empty ? bands[b].pointMin[a] : min(space.pointMin[a], bands[b].pointMin[a]);
+                    space.pointMax[a] = empty ? bands[b].pointMax[a] : max(space.pointMax[a], bands[b].pointMax[a]);
+                }
+                empty = false;
+            }
+        }
+        
+        //--------------------------------------------------------------
+        void runTask(int b) {
+            PointBand &band = bands[b];
+            int numPoints = band.positions.size();
+            
+            if(phase == 0) {
+                band.cells.resize(numPoints);
+                if(numPoints > 0) space->cellIndicesForPositions(&band.positions[0], &band.cells[0], numPoints);
+                if(space->compact && numPoints > 0) {
+                    band.pointMin = band.pointMax = band.positions[0];
+                    for(int i=1; i<numPoints; i++) {
+                        const ofVec3f &p = band.positions[i];
+                        band.pointMin.x = min(band.pointMin.x, p.x);
+                        band.pointMin.y = min(band.pointMin.y, p.y);
+                        band.pointMin.z = min(band.pointMin.z, p.z);
+                        band.pointMax.x = max(band.pointMax.x, p.x);
+                        band.pointMax.y = max(band.pointMax.y, p.y);
+                        band.pointMax.z = max(band.pointMax.z, p.z);
+                    }
+                }
+                if(space->sparse) {
+                    // sort points by cell and count the points of each cell
+                    band.keys.resize(numPoints);
+                    for(int i=0; i<numPoints; i++) band.keys[i] = (unsigned long long)band.cells[i] << 32 | i;
+                    radixSortByCell(band.keys, band.sortTemp, space->getNumCellsTotal());
+                    band.runCells.clear();
+                    band.runStarts.clear();
+                    for(int k=0; k<numPoints; k++) {
+                        unsigned int cell = band.keys[k] >> 32;
+                        if(band.runCells.empty() || band.runCells.back() != cell) {
+                            band.runCells.push_back(cell);
+                            band.runStarts.push_back(0);
+                        }
+                        band.runStarts.back()++;
+                    }
+                } else {
+                    band.cellCursors.assign(space->getNumCellsTotal(), 0);
+                    for(int i=0; i<numPoints; i++) band.cellCursors[band.cells[i]]++;
+                }
+            } else if(space->sparse) {
+                // write position of each point from its run's position, in sorted order
+                int r = -1;
+                unsigned int dst = 0;
+                for(int k=0; k<numPoints; k++) {
+                    unsigned int cell = band.keys[k] >> 32;
+                    if(r < 0 || band.runCells[r] != cell) dst = band.runStarts[++r];
+                    band.cells[band.keys[k] & 0xffffffff] = dst++;
+                }
+                if(numPoints > 0) space->storePointsAt(&band.positions[0], &band.colors[0], &band.cells[0], numPoints);
+            } else {
+                if(numPoints > 0) space->storePoints(&band.positions[0], &band.colors[0], &band.cells[0], numPoints, &band.cellCursors[0]);
+            }
+        }
+    };
+    
+    
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // recycles Spaces evicted from a SpaceTime so their buffers keep their capacity
+    // safe to get Spaces on one thread and release them on another
+    template <typename SpaceType>
+    class SpacePool {
+    public:
+        
+        //--------------------------------------------------------------
+        SpacePool() {
+            numHits = 0;
+            numMisses = 0;
+        }
+        
+        //--------------------------------------------------------------
+        ~SpacePool() {
+            clear();
+        }
+        
+        //--------------------------------------------------------------
+        // get a Space with given cells, storage format and boundaries, reusing a recycled one when available
+        SpaceType* getSpace(ofVec3f numCells, ofVec3f bmin, ofVec3f bmax, const SpaceFormat &format = SpaceFormat()) {
+            mutex.lock();
+            if(freeSpaces.empty()) {
+                numMisses++;
+                mutex.unlock();
+                return new SpaceType(numCells, bmin, bmax, format);
+            }
+            
+            numHits++;
+            SpaceType* space = freeSpaces.back();
+            freeSpaces.pop_back();
+            mutex.unlock();
+            
+            space->setFormat(numCells, format);
+            space->setBoundaries(bmin, bmax);
+            return space;
+        }
+        
+        //--------------------------------------------------------------
+        // hand a Space back to the pool for reuse
+        void releaseSpace(SpaceType* space) {
+            ofScopedLock lock(mutex);
+            freeSpaces.push_back(space);
+        }
+        
+        //--------------------------------------------------------------
+        // delete all recycled Spaces
+        void clear() {
+            ofScopedLock lock(mutex);
+            for(int i=0; i<freeSpaces.size(); i++) {
+                delete freeSpaces[i];
+            }
+            freeSpaces.clear();
+        }
+        
+        //--------------------------------------------------------------
+        // number of getSpace calls served by a recycled Space
+        unsigned long getNumHits() {
+            ofScopedLock lock(mutex);
+            return numHits;
+        }
+        
+        //--------------------------------------------------------------
+        // number of getSpace calls which had to allocate a new Space
+        unsigned long getNumMisses() {
+            ofScopedLock lock(mutex);
+            return numMisses;
+        }
+        
+        //--------------------------------------------------------------
+        // number of Spaces waiting to be reused
+        int getNumFree() {
+            ofScopedLock lock(mutex);
+            return freeSpaces.size();
+        }
+        
+        //--------------------------------------------------------------
+        // number of bytes held by Spaces waiting to be reused
+        size_t getBytesRetained() {
+            ofScopedLock lock(mutex);
+            size_t bytes = 0;
+            for(int i=0; i<freeSpaces.size(); i++) {
+                bytes += freeSpaces[i]->getBytesReserved();
+            }
+            return bytes;
+        }
+        
+    protected:
+        ofMutex mutex;
+        vector< SpaceType* > freeSpaces;
+        unsigned long numHits;
+        unsigned long numMisses;
+    };
+    
+    
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    template <typename SpaceType>   // the type of Space stored for each quantum time frame (e.g. SpaceT<ofMesh>, PointSpace)
     class SpaceTime {
     public:
         
         //--------------------------------------------------------------
-        // set maximum number of quantum time frames
+        SpaceTime() {
+            pool = NULL;
+            maxFrames = 0;
+            numFrames = 0;
+            head = 0;
+        }
+        
+        //--------------------------------------------------------------
+        ~SpaceTime() {
+            clear();
+        }
+        
+        //--------------------------------------------------------------
+        // evicted Spaces are handed back to this pool instead of being deleted (NULL to delete)
+        void setPool(SpacePool<SpaceType>* pool) {
+            this->pool = pool;
+        }
+        
+        //--------------------------------------------------------------
+        // number of cells of the Spaces stored in the history (for the owner to keep track of)
+        void setSpaceNumCells(ofVec3f numCells) {
+            spaceNumCells = numCells;
+        }
+        
+        //--------------------------------------------------------------
+        ofVec3f getSpaceNumCells() {
+            return spaceNumCells;
+        }
+        
+        //--------------------------------------------------------------
+        // set maximum number of quantum time frames (keeps the most recent frames)
         void setMaxFrames(int m) {
+            vector< SpaceType* > newSpaces(m, (SpaceType*)NULL);
+            int numKept = min(numFrames, m);
+            for(int f=0; f<numFrames; f++) {
+                if(f < numKept) newSpaces[numKept - 1 - f] = getSpaceAtFrame(f);
+                else recycleSpace(getSpaceAtFrame(f));
+            }
+            spaces.swap(newSpaces);
             maxFrames = m;
+            numFrames = numKept;
+            head = maxFrames > 0 ? numFrames % maxFrames : 0;
+        }
+        
+        //--------------------------------------------------------------
+        // get maximum number of quantum time frames
+        int getMaxFrames() {
+            return maxFrames;
         }
         
         //--------------------------------------------------------------
         // get current number of quantum time frames
         int getNumFrames() {
-            return spaces.size();
+            return numFrames;
         }
 
         //--------------------------------------------------------------
-        // get Space data for given quantum frame (0...numFrames-1)
-        SpaceT<T>* getSpaceAtFrame(int f) {
-            return spaces[f];
+        // get number of bytes allocated by all frames in the history
+        size_t getBytesReserved() {
+            size_t bytes = 0;
+            for(int f=0; f<numFrames; f++) {
+                bytes += getSpaceAtFrame(f)->getBytesReserved();
+            }
+            return bytes;
+        }
+        
+        //--------------------------------------------------------------
+        // get Space data for given quantum frame (0...numFrames-1), 0 is most recent
+        SpaceType* getSpaceAtFrame(int f) {
+            return spaces[(head - 1 - f + maxFrames) % maxFrames];
         }
         
         //--------------------------------------------------------------
         // get Space data for given quantum time (0...1)
-        SpaceT<T>* getSpaceAtTime(float t) {
-            return getSpaceAtFrame(floor(t * (spaces.size()-1)));
+        SpaceType* getSpaceAtTime(float t) {
+            return getSpaceAtFrame(floor(t * (numFrames-1)));
         }
 
         
         //--------------------------------------------------------------
-        // insert a new Space data (to time==0)
-        void addSpace(SpaceT<T>* space) {
-            spaces.insert(spaces.begin(), space);
-            while(spaces.size() > maxFrames) {
-                delete spaces.back();
-                spaces.pop_back();
+        // insert a new Space data (to time==0), overwriting the oldest slot when full
+        void addSpace(SpaceType* space) {
+            if(maxFrames <= 0) {
+                recycleSpace(space);
+                return;
             }
+            
+            if(spaces[head]) recycleSpace(spaces[head]);
+            spaces[head] = space;
+            head = (head + 1) % maxFrames;
+            if(numFrames < maxFrames) numFrames++;
         }
         
         //--------------------------------------------------------------
         void clear() {
             for(int i=0; i<spaces.size(); i++) {
-                delete spaces[i];
+                if(spaces[i]) recycleSpace(spaces[i]);
+                spaces[i] = NULL;
             }
-            spaces.clear();
+            numFrames = 0;
+            head = 0;
         }
 
         
     protected:
-        vector< SpaceT<T>* > spaces;
+        //--------------------------------------------------------------
+        void recycleSpace(SpaceType* space) {
+            if(pool) pool->releaseSpace(space);
+            else delete space;
+        }
+        
+        SpacePool<SpaceType>* pool;
+        ofVec3f spaceNumCells;
+        vector< SpaceType* > spaces;    // ring of maxFrames slots, head is the next slot to write
         int maxFrames;
+        int numFrames;
+        int head;
+    };
+    
+    
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // composes one point cloud from a SpaceTime of PointSpaces, taking each cell from the frame of the given age
+    // every chunk of cells collects the cells which hold points in their source frame, the chunks' point counts are
+    // prefix summed into output offsets, the output is sized once and then only the collected cells are copied, in parallel
+    class PointSpaceTimeComposer : protected ParallelJob {
+    public:
+        
+        //--------------------------------------------------------------
+        PointSpaceTimeComposer() {
+            cellAges = NULL;
+            numCellsTotal = 0;
+            numChunks = 0;
+            phase = 0;
+        }
+        
+        //--------------------------------------------------------------
+        // cellAges holds the frame age (0...numFrames-1) for each of numCellsTotal cells
+        void compose(SpaceTime<PointSpace> &spaceTime, const int *cellAges, int numCellsTotal, vector<ofVec3f> &outVertices, vector<ofFloatColor> &outColors, ThreadPool *pool = NULL) {
+            if(spaceTime.getNumFrames() == 0 || numCellsTotal == 0) {
+                outVertices.clear();
+                outColors.clear();
+                return;
+            }
+            
+            this->cellAges = cellAges;
+            this->numCellsTotal = numCellsTotal;
+            frames.resize(spaceTime.getNumFrames());
+            for(int f=0; f<frames.size(); f++) frames[f] = spaceTime.getSpaceAtFrame(f);
+            numChunks = min(numCellsTotal, pool ? pool->getNumThreads() * 8 : 1);
+            chunks.resize(numChunks);
+            
+            // pass 1: collect the non-empty cells of each chunk in their source frames
+            run(0, pool);
+            
+            // prefix sum chunk counts into output offsets and size output once
+            unsigned int numPoints = 0;
+            for(int i=0; i<numChunks; i++) {
+                chunks[i].outOffset = numPoints;
+                numPoints += chunks[i].numPoints;
+            }
+            outVertices.resize(numPoints);
+            outColors.resize(numPoints);
+            this->outVertices = numPoints > 0 ? &outVertices[0] : NULL;
+            this->outColors = numPoints > 0 ? &outColors[0] : NULL;
+            
+            // pass 2: copy every cell into its output range
+            if(numPoints > 0) run(1, pool);
+        }
+        
+    protected:
+        struct Chunk {
+            vector<unsigned int> cells;     // cells with points in their source frame
+            vector<unsigned int> counts;    // number of points of each of cells
+            unsigned int numPoints;
+            unsigned int outOffset;
+        };
+        
+        vector<PointSpace*> frames;         // frames by age
+        vector<Chunk> chunks;               // chunk i covers cells [i * numCellsTotal / numChunks, (i + 1) * numCellsTotal / numChunks)
+        const int *cellAges;
+        int numCellsTotal;
+        int numChunks;
+        int phase;
+        ofVec3f *outVertices;
+        ofFloatColor *outColors;
+        
+        //--------------------------------------------------------------
+        void run(int phase, ThreadPool *pool) {
+            this->phase = phase;
+            if(pool) pool->run(*this, numChunks);
+            else for(int i=0; i<numChunks; i++) runTask(i);
+        }
+        
+        //--------------------------------------------------------------
+        void runTask(int chunk) {
+            Chunk &ch = chunks[chunk];
+            if(phase == 0) {
+                int cBegin = (long long)chunk * numCellsTotal / numChunks;
+                int cEnd = (long long)(chunk + 1) * numCellsTotal / numChunks;
+                ch.cells.clear();
+                ch.counts.clear();
+                ch.numPoints = 0;
+                for(int c=cBegin; c<cEnd; c++) {
+                    int n = frames[cellAges[c]]->getCellNumPoints(c);
+                    if(n == 0) continue;
+                    ch.cells.push_back(c);
+                    ch.counts.push_back(n);
+                    ch.numPoints += n;
+                }
+            } else {
+                unsigned int o = ch.outOffset;
+                for(int i=0; i<ch.cells.size(); i++) {
+                    int c = ch.cells[i];
+                    frames[cellAges[c]]->copyCellPoints(c, outVertices + o, outColors + o);
+                    o += ch.counts[i];
+                }
+            }
+        }
     };
 }
\ No newline at end of file
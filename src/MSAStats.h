@@ -0,0 +1,180 @@
+#pragma once
+
+#include "ofMain.h"
+#include <iomanip>
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // rolling window of the most recent durations of one stage (in microseconds)
+    class StageTimes {
+    public:
+        
+        //--------------------------------------------------------------
+        StageTimes(int windowSize = 300) {
+            samples.resize(windowSize);
+            numSamples = 0;
+            numTotal = 0;
+        }
+        
+        //--------------------------------------------------------------
+        void add(unsigned long long micros) {
+            samples[numTotal % samples.size()] = micros;
+            numTotal++;
+            if(numSamples < samples.size()) numSamples++;
+        }
+        
+        //--------------------------------------------------------------
+        // number of samples in the window, and ever added
+        int getNumSamples() const {
+            return numSamples;
+        }
+        
+        unsigned long long getNumTotal() const {
+            return numTotal;
+        }
+        
+        //--------------------------------------------------------------
+        // p (0...1) percentile of the window in milliseconds
+        float getPercentile(float p) const {
+            if(numSamples == 0) return 0;
+            vector<unsigned long long> sorted(samples.begin(), samples.begin() + numSamples);
+            int n = ofClamp(p * numSamples, 0, numSamples - 1);
+            std::nth_element(sorted.begin(), sorted.begin() + n, sorted.end());
+            return sorted[n] / 1000.0f;
+        }
+        
+        //--------------------------------------------------------------
+        // longest duration in the window in milliseconds
+        float getMax() const {
+            if(numSamples == 0) return 0;
+            return *std::max_element(samples.begin(), samples.begin() + numSamples) / 1000.0f;
+        }
+        
+        //--------------------------------------------------------------
+        // mean of the window in milliseconds
+        float getMean() const {
+            if(numSamples == 0) return 0;
+            unsigned long long sum = 0;
+            for(int i=0; i<numSamples; i++) sum += samples[i];
+            return sum / 1000.0f / numSamples;
+        }
+    
+    protected:
+        vector<unsigned long long> samples;
+        int numSamples;
+        unsigned long long numTotal;
+    };
+
+
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // per stage frame times, stages are created on first use and kept in that order
+    // stages may be timed from any thread
+    class Stats {
+    public:
+        
+        //--------------------------------------------------------------
+        ~Stats() {
+            for(int i=0; i<stages.size(); i++) delete stages[i].times;
+        }
+        
+        //--------------------------------------------------------------
+        void add(const string &stage, unsigned long long micros) {
+            ofScopedLock lock(mutex);
+            getStage(stage).add(micros);
+        }
+        
+        //--------------------------------------------------------------
+        // forget all samples
+        void clear() {
+            ofScopedLock lock(mutex);
+            for(int i=0; i<stages.size(); i++) delete stages[i].times;
+            stages.clear();
+        }
+        
+        //--------------------------------------------------------------
+        // one line per stage with p50 / p95 / p99 / max in milliseconds
+        string getReport() {
+            ofScopedLock lock(mutex);
+            stringstream s;
+            s << fixed << setprecision(2);
+            s << "stage (ms)        p50     p95     p99     max" << endl;
+            for(int i=0; i<stages.size(); i++) {
+                StageTimes &t = *stages[i].times;
+                s << left << setw(14) << stages[i].name << right
+                << setw(8) << t.getPercentile(0.5f)
+                << setw(8) << t.getPercentile(0.95f)
+                << setw(8) << t.getPercentile(0.99f)
+                << setw(8) << t.getMax()
+                << endl;
+            }
+            return s.str();
+        }
+        
+        //--------------------------------------------------------------
+        // write the same summary as getReport to a csv file (path relative to data folder)
+        bool saveCsv(string path) {
+            ofScopedLock lock(mutex);
+            ofstream file(ofToDataPath(path).c_str());
+            if(!file.good()) {
+                ofLog(OF_LOG_ERROR, "Stats::saveCsv: can't open " + path);
+                return false;
+            }
+            file << "stage,samples,total,mean_ms,p50_ms,p95_ms,p99_ms,max_ms" << endl;
+            for(int i=0; i<stages.size(); i++) {
+                StageTimes &t = *stages[i].times;
+                file << stages[i].name << "," << t.getNumSamples() << "," << t.getNumTotal() << ","
+                << t.getMean() << "," << t.getPercentile(0.5f) << "," << t.getPercentile(0.95f) << "," << t.getPercentile(0.99f) << "," << t.getMax() << endl;
+            }
+            ofLog(OF_LOG_NOTICE, "Stats::saveCsv: saved " + path);
+            return true;
+        }
+    
+    protected:
+        struct Stage {
+            string name;
+            StageTimes *times;
+        };
+        
+        ofMutex mutex;
+        vector<Stage> stages;
+        
+        //--------------------------------------------------------------
+        StageTimes& getStage(const string &name) {
+            for(int i=0; i<stages.size(); i++) if(stages[i].name == name) return *stages[i].times;
+            Stage stage;
+            stage.name = name;
+            stage.times = new StageTimes();
+            stages.push_back(stage);
+            return *stage.times;
+        }
+    };
+
+
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // adds the time from construction to destruction to a stage of stats (does nothing if stats is NULL)
+    class ScopedTimer {
+    public:
+        
+        //--------------------------------------------------------------
+        ScopedTimer(Stats *stats, const string &stage) : stats(stats), stage(stage) {
+            if(stats) startMicros = ofGetElapsedTimeMicros();
+        }
+        
+        //--------------------------------------------------------------
+        ~ScopedTimer() {
+            if(stats) stats->add(stage, ofGetElapsedTimeMicros() - startMicros);
+        }
+    
+    protected:
+        Stats *stats;
+        string stage;
+        unsigned long long startMicros;
+    };
+}
@@ -0,0 +1,327 @@
+#pragma once
+
+#include "ofMain.h"
+#include "MSADepthSource.h"
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // renders an animated 3D scene as depth + color frames through a kinect-like pinhole camera:
+    // spheres on seeded orbits, a figure walking back and forth, a noisy floor and back wall, and dropped readings
+    // every frame depends only on the settings, seed and frame number, so it can be reproduced exactly by the same build
+    // on the same platform (other compilers and math libraries may round sinf, cosf and sqrtf differently)
+    // a run only repeats exactly with setRealtime(false), in realtime mode the clock decides which frames it sees
+    class SyntheticDepthSource : public DepthSource {
+    public:
+        
+        // scene settings, change before setup (or call setFrameNum to re-render)
+        int numSpheres;
+        bool doFigure;
+        bool doFloor;
+        bool doWall;
+        float wallDepth;        // millimetres
+        float noise;            // depth noise on floor and wall (millimetres)
+        float dropout;          // probability of a pixel having no depth reading
+        
+        //--------------------------------------------------------------
+        SyntheticDepthSource() {
+            numSpheres = 3;
+            doFigure = true;
+            doFloor = true;
+            doWall = true;
+            wallDepth = 2800;
+            noise = 8;
+            dropout = 0.02f;
+            
+            width = 0;
+            height = 0;
+            fps = 30;
+            seed = 0;
+            realtime = true;
+            frameNum = 0;
+            bNewFrame = false;
+            bTextureDirty = false;
+            startTime = 0;
+        }
+        
+        //--------------------------------------------------------------
+        // width x height images at fps frames per second, seed picks the sphere orbits and colors
+        void setup(int width, int height, float fps = 30, unsigned int seed = 0) {
+            this->width = width;
+            this->height = height;
+            this->fps = fps;
+            this->seed = seed;
+            focalLength = 580.0f * width / 640.0f;
+            depth.assign(width * height, 0);
+            pixels.allocate(width, height, 3);
+            
+            // seeded sphere orbits
+            spheres.resize(numSpheres);
+            unsigned int r = seed;
+            for(int s=0; s<numSpheres; s++) {
+                Sphere &sphere = spheres[s];
+                sphere.center.set(ofLerp(-500, 500, random(r)), ofLerp(-300, 200, random(r)), ofLerp(1400, 2200, random(r)));
+                sphere.orbit.set(ofLerp(100, 500, random(r)), ofLerp(50, 250, random(r)), ofLerp(100, 500, random(r)));
+                sphere.speed = ofLerp(0.2f, 1.0f, random(r));
+                sphere.phase = random(r) * TWO_PI;
+                sphere.radius = ofLerp(120, 280, random(r));
+                sphere.color.set(ofLerp(60, 255, random(r)), ofLerp(60, 255, random(r)), ofLerp(60, 255, random(r)));
+            }
+            
+            startTime = ofGetElapsedTimef();
+            setFrameNum(0);
+        }
+        
+        //--------------------------------------------------------------
+        // realtime (default): update() renders a new frame whenever 1/fps seconds have passed
+        // otherwise every update() renders the next frame, as fast as the caller asks
+        void setRealtime(bool b) {
+            realtime = b;
+            startTime = ofGetElapsedTimef() - frameNum / fps;
+        }
+        
+        //--------------------------------------------------------------
+        // jump to and render frame f
+        void setFrameNum(int f) {
+            frameNum = f;
+            render();
+            bNewFrame = true;
+        }
+        
+        //--------------------------------------------------------------
+        int getFrameNum() {
+            return frameNum;
+        }
+        
+        //--------------------------------------------------------------
+        float getFps() {
+            return fps;
+        }
+
+
+        //--------------------------------------------------------------
+        unsigned short* getRawDepthPixels() {
+            return depth.empty() ? NULL : &depth[0];
+        }
+        
+        //--------------------------------------------------------------
+        ofVec3f getWorldCoordinateAt(float x, float y, float z) {
+            return ofVec3f((x - width * 0.5f) / focalLength * z, (y - height * 0.5f) / focalLength * z, z);
+        }
+        
+        //--------------------------------------------------------------
+        unsigned char* getPixels() {
+            return pixels.getPixels();
+        }
+        
+        ofPixels& getPixelsRef() {
+            return pixels;
+        }
+        
+        //--------------------------------------------------------------
+        void update() {
+            bNewFrame = false;
+            if(realtime) {
+                int f = (ofGetElapsedTimef() - startTime) * fps;
+                if(f > frameNum) setFrameNum(f);
+            } else {
+                setFrameNum(frameNum + 1);
+            }
+        }
+        
+        bool isFrameNew() {
+            return bNewFrame;
+        }
+        
+        void close() {
+        }
+        
+        //--------------------------------------------------------------
+        void draw(float x, float y) {
+            draw(x, y, width, height);
+        }
+        
+        void draw(float x, float y, float w, float h) {
+            if(bTextureDirty) {
+                if(!texture.bAllocated()) texture.allocate(width, height, GL_RGB);
+                texture.loadData(pixels.getPixels(), width, height, GL_RGB);
+                bTextureDirty = false;
+            }
+            texture.draw(x, y, w, h);
+        }
+        
+        float getWidth() {
+            return width;
+        }
+        
+        float getHeight() {
+            return height;
+        }
+    
+    protected:
+        struct Sphere {
+            ofVec3f center, orbit;
+            float speed, phase;
+            float radius;
+            ofVec3f color;
+        };
+        
+        // a line segment with a radius, seen from the front
+        struct Capsule {
+            float ax, ay, bx, by;
+            float radius;
+        };
+        
+        int width, height;
+        float fps;
+        float focalLength;
+        unsigned int seed;
+        bool realtime;
+        int frameNum;
+        bool bNewFrame;
+        float startTime;
+        vector<Sphere> spheres;
+        
+        vector<unsigned short> depth;
+        ofPixels pixels;
+        ofTexture texture;
+        bool bTextureDirty;
+        
+        //--------------------------------------------------------------
+        // next of a seeded sequence of random numbers 0...1
+        static float random(unsigned int &state) {
+            state = state * 1664525 + 1013904223;
+            return (state >> 8) / 16777216.0f;
+        }
+        
+        //--------------------------------------------------------------
+        // random number 0...1 for pixel (i, j) of the current frame
+        float hash(int i, int j, int salt) {
+            unsigned int h = ((unsigned int)i * 73856093u) ^ ((unsigned int)j * 19349663u) ^ ((unsigned int)frameNum * 83492791u) ^ ((unsigned int)salt * 2654435761u) ^ seed;
+            h = (h ^ 61) ^ (h >> 16);
+            h *= 9;
+            h = h ^ (h >> 4);
+            h *= 0x27d4eb2d;
+            h = h ^ (h >> 15);
+            return (h >> 8) / 16777216.0f;
+        }
+        
+        //--------------------------------------------------------------
+        // torso, head, arms and legs of a figure walking left and right at figureDepth
+        void getFigure(vector<Capsule> &capsules, float &figureDepth) {
+            float t = frameNum / fps;
+            float walk = t * 0.25f;
+            float x = (fabsf(fmodf(walk, 2.0f) - 1.0f) * 2 - 1) * 700;    // back and forth
+            float swing = sinf(t * 6.0f) * 0.45f;
+            figureDepth = 2200;
+            
+            capsules.clear();
+            Capsule c;
+            // torso and head
+            c.ax = x; c.ay = -420; c.bx = x; c.by = -20; c.radius = 160; capsules.push_back(c);
+            c.ax = x; c.ay = -680; c.bx = x; c.by = -680; c.radius = 110; capsules.push_back(c);
+            // legs from the hips
+            for(int side=-1; side<=1; side+=2) {
+                float a = swing * side;
+                c.ax = x + side * 80; c.ay = 0; c.bx = c.ax + sinf(a) * 850; c.by = cosf(a) * 850; c.radius = 70; capsules.push_back(c);
+            }
+            // arms from the shoulders, swinging against the legs
+            for(int side=-1; side<=1; side+=2) {
+                float a = -swing * side;
+                c.ax = x + side * 210; c.ay = -480; c.bx = c.ax + sinf(a) * 600; c.by = c.ay + cosf(a) * 600; c.radius = 50; capsules.push_back(c);
+            }
+        }
+        
+        //--------------------------------------------------------------
+        void render() {
+            if(width == 0 || height == 0) return;
+            
+            float t = frameNum / fps;
+            vector<ofVec3f> centers(spheres.size());
+            for(int s=0; s<spheres.size(); s++) {
+                Sphere &sphere = spheres[s];
+                float a = t * sphere.speed + sphere.phase;
+                centers[s] = sphere.center + ofVec3f(cosf(a) * sphere.orbit.x, sinf(a * 1.3f) * sphere.orbit.y, sinf(a) * sphere.orbit.z);
+            }
+            
+            vector<Capsule> capsules;
+            float figureDepth = 0;
+            if(doFigure) getFigure(capsules, figureDepth);
+            
+            const float floorHeight = 900;      // camera height above the floor
+            unsigned char *rgb = pixels.getPixels();
+            for(int j=0; j<height; j++) {
+                float ry = (j - height * 0.5f) / focalLength;
+                for(int i=0; i<width; i++) {
+                    float rx = (i - width * 0.5f) / focalLength;
+                    float z = 0;
+                    ofVec3f color;
+                    
+                    // background: wall and floor, with depth noise
+                    if(doWall) {
+                        z = wallDepth;
+                        bool check = (int(floorf(rx * z / 250)) + int(floorf(ry * z / 250))) & 1;
+                        color.set(check ? 170 : 140, check ? 160 : 130, 120);
+                    }
+                    if(doFloor && ry > 0) {
+                        float zf = floorHeight / ry;
+                        if(z == 0 || zf < z) {
+                            z = zf;
+                            bool check = (int(floorf(rx * z / 400)) + int(floorf(z / 400))) & 1;
+                            color.set(check ? 90 : 70, check ? 80 : 60, 60);
+                        }
+                    }
+                    if(z > 0) z += (hash(i, j, 1) - 0.5f) * 2 * noise;
+                    
+                    // figure, as rounded capsules facing the camera
+                    if(doFigure) {
+                        float wx = rx * figureDepth;
+                        float wy = ry * figureDepth;
+                        for(int c=0; c<capsules.size(); c++) {
+                            Capsule &cap = capsules[c];
+                            float dx = cap.bx - cap.ax, dy = cap.by - cap.ay;
+                            float len2 = dx * dx + dy * dy;
+                            float u = len2 > 0 ? ofClamp(((wx - cap.ax) * dx + (wy - cap.ay) * dy) / len2, 0, 1) : 0;
+                            float ex = wx - (cap.ax + u * dx), ey = wy - (cap.ay + u * dy);
+                            float d2 = ex * ex + ey * ey;
+                            if(d2 < cap.radius * cap.radius) {
+                                float zc = figureDepth - sqrtf(cap.radius * cap.radius - d2);
+                                if(z == 0 || zc < z) {
+                                    z = zc;
+                                    color.set(c == 1 ? 220 : 60, c == 1 ? 180 : 90, c == 1 ? 150 : 160);
+                                }
+                            }
+                        }
+                    }
+                    
+                    // spheres
+                    for(int s=0; s<centers.size(); s++) {
+                        // |(rx, ry, 1) z - c|^2 = r^2
+                        const ofVec3f &c = centers[s];
+                        float a = rx * rx + ry * ry + 1;
+                        float b = rx * c.x + ry * c.y + c.z;
+                        float disc = b * b - a * (c.x * c.x + c.y * c.y + c.z * c.z - spheres[s].radius * spheres[s].radius);
+                        if(disc < 0) continue;
+                        float zs = (b - sqrtf(disc)) / a;
+                        if(zs > 0 && (z == 0 || zs < z)) {
+                            z = zs;
+                            // shade by how much the surface faces the camera
+                            ofVec3f n = (ofVec3f(rx * zs, ry * zs, zs) - c) / spheres[s].radius;
+                            color = spheres[s].color * ofClamp(-n.z, 0.3f, 1);
+                        }
+                    }
+                    
+                    int p = j * width + i;
+                    bool dropped = z <= 0 || z > 10000 || hash(i, j, 2) < dropout;
+                    depth[p] = dropped ? 0 : (unsigned short)z;
+                    rgb[p * 3 + 0] = color.x;
+                    rgb[p * 3 + 1] = color.y;
+                    rgb[p * 3 + 2] = color.z;
+                }
+            }
+            bTextureDirty = true;
+        }
+    };
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "ofMain.h"
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // maps each quantum cell of a Space to the age of the frame it is drawn from
+    // ages are looked up from a table built when the mode, cells or number of frames change
+    class TemporalGradient {
+    public:
+        
+        //--------------------------------------------------------------
+        TemporalGradient() {
+            mode = 0;
+            numFrames = 0;
+            rotation = 0;
+        }
+        
+        //--------------------------------------------------------------
+        // set gradient mode (see getTime) and number of quantum cells on each axis
+        void setup(int mode, ofVec3f numCells) {
+            this->mode = mode;
+            this->numCells = numCells;
+            
+            int nx = max(1, (int)numCells.x);
+            int ny = max(1, (int)numCells.y);
+            int nz = max(1, (int)numCells.z);
+            cellTimes.resize(nx * ny * nz);
+            for(int k=0; k<nz; k++) {
+                for(int j=0; j<ny; j++) {
+                    for(int i=0; i<nx; i++) {
+                        cellTimes[k * nx * ny + j * nx + i] = getTime(i * 1.0f/nx, j * 1.0f/ny, k * 1.0f/nz);
+                    }
+                }
+            }
+            
+            numFrames = 0;  // force rebuild of ages
+            rotation = 0;
+        }
+        
+        //--------------------------------------------------------------
+        // set number of frames in the history, rebuilds the age table if it changed
+        void setNumFrames(int n) {
+            if(n == numFrames) return;
+            numFrames = n;
+            
+            int numCellsTotal = cellTimes.size();
+            cellAges.resize(numCellsTotal * 2);
+            for(int c=0; c<numCellsTotal; c++) {
+                cellAges[c] = floor(cellTimes[c] * (numFrames - 1));
+                if(cellAges[c] < 0) cellAges[c] = 0;
+                cellAges[c + numCellsTotal] = cellAges[c];    // second copy so rotated lookups never wrap
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // advance to the next composed frame (random mode draws a new rotation of its table)
+        void nextFrame() {
+            if(mode == 8 && !cellTimes.empty()) rotation = ofRandom(cellTimes.size());
+            else rotation = 0;
+        }
+        
+        //--------------------------------------------------------------
+        // get age of the frame to use for given linear cell index (0 is most recent)
+        int getCellAge(int cell) {
+            return cellAges[cell + rotation];
+        }
+        
+        //--------------------------------------------------------------
+        // get ages for all cells (getNumCellsTotal entries, for the current frame)
+        const int* getCellAges() {
+            return cellAges.empty() ? NULL : &cellAges[rotation];
+        }
+        
+        //--------------------------------------------------------------
+        int getNumCellsTotal() {
+            return cellTimes.size();
+        }
+        
+        //--------------------------------------------------------------
+        // get gradient time (0...1) for normalized cell position (0...1 on each axis)
+        float getTime(float u, float v, float w) {
+            float t = 0;
+            switch(mode) {
+                case 0:
+                    t = 0;  // use most recent mesh
+                    break;
+                    
+                case 1:
+                    t = u; // left to right
+                    break;
+                    
+                case 2:
+                    t = 1.0f - u; // right to left
+                    break;
+                    
+                case 3:
+                    t = v; // up to down
+                    break;
+                    
+                case 4:
+                    t = 1.0f - v; // down to up
+                    break;
+                    
+                case 5:
+                    t = w; // front to back
+                    break;
+                    
+                case 6:
+                    t = 1.0f - w; //  back to front
+                    break;
+                    
+                case 7:
+                {
+                    // spherical
+                    float tx = u * 2 - 1;
+                    float ty = v * 2 - 1;
+                    float tz = w * 2 - 1;
+                    t = tx * tx + ty * ty + tz * tz;
+//                    t = sqrt(t);
+                }
+                    break;
+                    
+                case 8:
+                    t = ofRandomuf();
+                    break;
+                    
+                case 9:
+                    t = 1;
+                    break;
+                    
+            }
+            
+            return ofClamp(t, 0, 1);
+        }
+        
+    protected:
+        int mode;
+        ofVec3f numCells;
+        int numFrames;
+        int rotation;
+        vector<float> cellTimes;    // gradient time (0...1) for each cell
+        vector<int> cellAges;       // frame age for each cell, stored twice
+    };
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "ofMain.h"
+#include "Poco/Condition.h"
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // work split into numbered tasks which a ThreadPool runs in parallel
+    class ParallelJob {
+    public:
+        virtual ~ParallelJob() {}
+        virtual void runTask(int task) = 0;
+    };
+    
+    
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // fixed set of worker threads sharing the tasks of one ParallelJob at a time with the calling thread
+    class ThreadPool {
+    public:
+        
+        //--------------------------------------------------------------
+        ThreadPool() {
+            job = NULL;
+            numTasks = 0;
+            nextTask = 0;
+            numTasksDone = 0;
+            numActiveWorkers = 0;
+            generation = 0;
+            stopping = false;
+        }
+        
+        //--------------------------------------------------------------
+        ~ThreadPool() {
+            stop();
+        }
+        
+        //--------------------------------------------------------------
+        // start worker threads, numThreads includes the calling thread (0 for one per core)
+        void setup(int numThreads = 0) {
+            stop();
+            if(numThreads <= 0) numThreads = getNumCores();
+            
+            stopping = false;
+            for(int i=0; i<numThreads-1; i++) {
+                Worker *worker = new Worker(this);
+                workers.push_back(worker);
+                worker->startThread(false, false);
+            }
+        }
+        
+        //--------------------------------------------------------------
+        // stop and join all worker threads
+        void stop() {
+            mutex.lock();
+            stopping = true;
+            workAvailable.broadcast();
+            mutex.unlock();
+            
+            for(int i=0; i<workers.size(); i++) {
+                workers[i]->waitForThread(true);
+                delete workers[i];
+            }
+            workers.clear();
+        }
+        
+        //--------------------------------------------------------------
+        // number of threads running tasks, including the calling thread
+        int getNumThreads() {
+            return workers.size() + 1;
+        }
+        
+        //--------------------------------------------------------------
+        // run tasks 0...numTasks-1 of job on all threads, returns when all are done
+        void run(ParallelJob &job, int numTasks) {
+            ofScopedLock runLock(runMutex);
+            
+            mutex.lock();
+            this->job = &job;
+            this->numTasks = numTasks;
+            nextTask = 0;
+            numTasksDone = 0;
+            generation++;
+            workAvailable.broadcast();
+            mutex.unlock();
+            
+            runTasks(job, numTasks);
+            
+            mutex.lock();
+            while(__sync_fetch_and_add(&numTasksDone, 0) < numTasks || numActiveWorkers > 0) workDone.wait(mutex);
+            this->job = NULL;
+            mutex.unlock();
+        }
+        
+        //--------------------------------------------------------------
+        static int getNumCores() {
+#ifdef TARGET_WIN32
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            return max(1, (int)info.dwNumberOfProcessors);
+#else
+            return max(1, (int)sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+        }
+        
+    protected:
+        
+        //--------------------------------------------------------------
+        class Worker : public ofThread {
+        public:
+            Worker(ThreadPool *pool) : pool(pool) {}
+            
+        protected:
+            ThreadPool *pool;
+            
+            void threadedFunction() {
+                pool->workerLoop();
+            }
+        };
+        
+        ofMutex runMutex;           // one job at a time
+        ofMutex mutex;              // guards everything below
+        Poco::Condition workAvailable;
+        Poco::Condition workDone;
+        vector<Worker*> workers;
+        ParallelJob *job;
+        int numTasks;
+        volatile int nextTask;      // claimed with atomic increments
+        volatile int numTasksDone;
+        int numActiveWorkers;
+        unsigned int generation;
+        bool stopping;
+        
+        //--------------------------------------------------------------
+        void runTasks(ParallelJob &job, int numTasks) {
+            int task;
+            while((task = __sync_fetch_and_add(&nextTask, 1)) < numTasks) {
+                job.runTask(task);
+                __sync_fetch_and_add(&numTasksDone, 1);
+            }
+        }
+        
+        //--------------------------------------------------------------
+        void workerLoop() {
+            unsigned int seenGeneration = 0;
+            mutex.lock();
+            while(true) {
+                while(!stopping && (generation == seenGeneration || job == NULL)) workAvailable.wait(mutex);
+                if(stopping) break;
+                
+                seenGeneration = generation;
+                ParallelJob *currentJob = job;
+                int currentNumTasks = numTasks;
+                numActiveWorkers++;
+                mutex.unlock();
+                
+                runTasks(*currentJob, currentNumTasks);
+                
+                mutex.lock();
+                numActiveWorkers--;
+                workDone.signal();
+            }
+            mutex.unlock();
+        }
+    };
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include "ofMain.h"
+#ifndef TARGET_WIN32
+#include <pthread.h>
+#endif
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // records begin / end events of named spans from any thread into a preallocated ring buffer
+    // (the oldest events are overwritten), and saves them as chrome://tracing / Perfetto json
+    // writers claim slots with an atomic increment and never wait, so it's cheap enough to leave in every stage
+    class Tracer {
+    public:
+        
+        //--------------------------------------------------------------
+        Tracer(int capacity = 65536) {
+            recording = 0;
+            setCapacity(capacity);
+        }
+        
+        //--------------------------------------------------------------
+        // number of events kept, clears all events. not thread safe, only call while nothing is being traced
+        void setCapacity(int n) {
+            events.clear();
+            events.resize(max(n, 1));
+            for(int i=0; i<events.size(); i++) events[i].sequence = 0;
+            next = 0;
+        }
+        
+        //--------------------------------------------------------------
+        void setRecording(bool b) {
+            __sync_lock_test_and_set(&recording, b ? 1 : 0);
+        }
+        
+        //--------------------------------------------------------------
+        bool isRecording() {
+            return __sync_fetch_and_add(&recording, 0) != 0;
+        }
+        
+        //--------------------------------------------------------------
+        // name the calling thread in the trace
+        void setThreadName(string name) {
+            ofScopedLock lock(mutex);
+            unsigned long tid = getThreadId();
+            for(int i=0; i<threadNames.size(); i++) {
+                if(threadNames[i].first == tid) {
+                    threadNames[i].second = name;
+                    return;
+                }
+            }
+            threadNames.push_back(make_pair(tid, name));
+        }
+        
+        //--------------------------------------------------------------
+        // add a begin or end event for the calling thread, name must stay valid until saved (i.e. a string literal)
+        // args are omitted when negative
+        void begin(const char *name, int frame = -1, int mode = -1, int points = -1, int cells = -1) {
+            add('B', name, frame, mode, points, cells);
+        }
+        
+        void end(const char *name, int frame = -1, int mode = -1, int points = -1, int cells = -1) {
+            add('E', name, frame, mode, points, cells);
+        }
+        
+        //--------------------------------------------------------------
+        // number of events currently held
+        int getNumEvents() {
+            unsigned int n = __sync_fetch_and_add(&next, 0);
+            return min<unsigned int>(n, events.size());
+        }
+        
+        //--------------------------------------------------------------
+        // write all held events, oldest first, to a json file (path relative to data folder)
+        // events still being written by other threads are skipped
+        bool save(string path) {
+            ofstream file(ofToDataPath(path).c_str());
+            if(!file.good()) {
+                ofLog(OF_LOG_ERROR, "Tracer::save: can't open " + path);
+                return false;
+            }
+            
+            file << "{\"traceEvents\":[" << endl;
+            bool first = true;
+            
+            mutex.lock();
+            for(int i=0; i<threadNames.size(); i++) {
+                if(!first) file << "," << endl;
+                first = false;
+                file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << threadNames[i].first << ",\"args\":{\"name\":\"" << threadNames[i].second << "\"}}";
+            }
+            mutex.unlock();
+            
+            unsigned int n = __sync_fetch_and_add(&next, 0);
+            unsigned int capacity = events.size();
+            int numSaved = 0;
+            for(unsigned int i = n > capacity ? n - capacity : 0; i < n; i++) {
+                // copy the event and check it wasn't being (re)written meanwhile
+                Event &slot = events[i % capacity];
+                if(__sync_fetch_and_add(&slot.sequence, 0) != i + 1) continue;
+                Event e = slot;
+                if(__sync_fetch_and_add(&slot.sequence, 0) != i + 1) continue;
+                
+                if(!first) file << "," << endl;
+                first = false;
+                file << "{\"name\":\"" << e.name << "\",\"ph\":\"" << e.phase << "\",\"pid\":0,\"tid\":" << e.tid << ",\"ts\":" << e.micros << ",\"args\":{";
+                static const char *argNames[] = { "frame", "mode", "points", "cells" };
+                bool firstArg = true;
+                for(int a=0; a<4; a++) {
+                    if(e.args[a] < 0) continue;
+                    if(!firstArg) file << ",";
+                    firstArg = false;
+                    file << "\"" << argNames[a] << "\":" << e.args[a];
+                }
+                file << "}}";
+                numSaved++;
+            }
+            file << endl << "],\"displayTimeUnit\":\"ms\"}" << endl;
+            
+            ofLog(OF_LOG_NOTICE, "Tracer::save: saved " + ofToString(numSaved) + " events to " + path);
+            return true;
+        }
+        
+        //--------------------------------------------------------------
+        static unsigned long getThreadId() {
+#ifdef TARGET_WIN32
+            return GetCurrentThreadId();
+#else
+            return (unsigned long)pthread_self();
+#endif
+        }
+    
+    protected:
+        struct Event {
+            volatile unsigned int sequence;     // index of the event + 1 once written, 0 while being written
+            const char *name;
+            char phase;
+            unsigned long tid;
+            unsigned long long micros;
+            int args[4];                        // frame, mode, points, cells
+        };
+        
+        vector<Event> events;
+        volatile unsigned int next;             // index of the next event to write
+        volatile int recording;
+        ofMutex mutex;                          // guards threadNames
+        vector< pair<unsigned long, string> > threadNames;
+        
+        //--------------------------------------------------------------
+        void add(char phase, const char *name, int frame, int mode, int points, int cells) {
+            if(!isRecording()) return;
+            unsigned int i = __sync_fetch_and_add(&next, 1);
+            Event &e = events[i % events.size()];
+            __sync_lock_test_and_set(&e.sequence, 0);
+            e.name = name;
+            e.phase = phase;
+            e.tid = getThreadId();
+            e.micros = ofGetElapsedTimeMicros();
+            e.args[0] = frame;
+            e.args[1] = mode;
+            e.args[2] = points;
+            e.args[3] = cells;
+            __sync_bool_compare_and_swap(&e.sequence, 0, i + 1);
+        }
+    };
+
+
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // traces a span from construction to destruction (does nothing if tracer is NULL or not recording)
+    // args known only once the work is done can be set before the span ends
+    class ScopedTrace {
+    public:
+        
+        //--------------------------------------------------------------
+        ScopedTrace(Tracer *tracer, const char *name, int frame = -1, int mode = -1) : tracer(tracer), name(name), frame(frame), mode(mode), points(-1), cells(-1) {
+            if(tracer && tracer->isRecording()) tracer->begin(name, frame, mode);
+            else this->tracer = NULL;
+        }
+        
+        //--------------------------------------------------------------
+        ~ScopedTrace() {
+            if(tracer) tracer->end(name, frame, mode, points, cells);
+        }
+        
+        //--------------------------------------------------------------
+        void setFrame(int f) {
+            frame = f;
+        }
+        
+        void setMode(int m) {
+            mode = m;
+        }
+        
+        void setPoints(int n) {
+            points = n;
+        }
+        
+        void setCells(int n) {
+            cells = n;
+        }
+    
+    protected:
+        Tracer *tracer;
+        const char *name;
+        int frame, mode, points, cells;
+    };
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "ofMain.h"
+
+namespace msa {
+    
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    //--------------------------------------------------------------
+    // hands the most recent of a stream of T from one writer thread to one reader thread without either waiting:
+    // the writer fills getWriteBuffer() and publishes it, the reader picks up the newest published buffer with update()
+    template <typename T>
+    class TripleBuffer {
+    public:
+        
+        //--------------------------------------------------------------
+        TripleBuffer() {
+            writeIndex = 0;
+            middle = 1;
+            readIndex = 2;
+        }
+        
+        //--------------------------------------------------------------
+        // buffer for the writer to fill
+        T& getWriteBuffer() {
+            return buffers[writeIndex];
+        }
+        
+        //--------------------------------------------------------------
+        // make the write buffer the newest for the reader, and continue writing into the spare buffer
+        void publish() {
+            __sync_synchronize();
+            writeIndex = __sync_lock_test_and_set(&middle, writeIndex | FRESH) & INDEX;
+        }
+        
+        //--------------------------------------------------------------
+        // switch the read buffer to the newest published buffer, returns false if nothing new was published
+        bool update() {
+            if((__sync_fetch_and_or(&middle, 0) & FRESH) == 0) return false;
+            readIndex = __sync_lock_test_and_set(&middle, readIndex) & INDEX;
+            __sync_synchronize();
+            return true;
+        }
+        
+        //--------------------------------------------------------------
+        // buffer for the reader, stays valid until the next update()
+        T& getReadBuffer() {
+            return buffers[readIndex];
+        }
+        
+    protected:
+        enum {
+            INDEX = 3,
+            FRESH = 4   // set in middle when it holds a buffer the reader hasn't seen
+        };
+        
+        T buffers[3];
+        int writeIndex;         // only touched by the writer
+        volatile int middle;    // exchanged by both
+        int readIndex;          // only touched by the reader
+    };
+}
@@ -1,8 +1,33 @@
 #include "testApp.h"
 #include "ofAppGlutWindow.h"
 
-int main() {
+// options: --synthetic [--size 640x480] [--fps 30] [--seed 0] [--fast]
+//          --play recording.msadepth [--fast]
+//          --compress (keep raw history compressed, for minute long scans)
+//          --disk history.slots [--rss 1024] (keep raw history in a memory mapped file, with at most 1024 MB of it mapped in)
+int main(int argc, char *argv[]) {
+    testApp *app = new testApp();
+    for(int i=1; i<argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--synthetic") app->useSynthetic = true;
+        else if(arg == "--size" && hasValue) {
+            vector<string> wh = ofSplitString(argv[++i], "x");
+            if(wh.size() == 2) {
+                app->syntheticWidth = ofToInt(wh[0]);
+                app->syntheticHeight = ofToInt(wh[1]);
+            }
+        }
+        else if(arg == "--fps" && hasValue) app->syntheticFps = ofToFloat(argv[++i]);
+        else if(arg == "--seed" && hasValue) app->syntheticSeed = ofToInt(argv[++i]);
+        else if(arg == "--play" && hasValue) app->playPath = argv[++i];
+        else if(arg == "--fast") app->playRealtime = false;
+        else if(arg == "--compress") app->compressHistory = true;
+        else if(arg == "--disk" && hasValue) app->diskHistoryPath = argv[++i];
+        else if(arg == "--rss" && hasValue) app->diskHistoryMaxResidentMB = ofToInt(argv[++i]);
+    }
+    
 	ofAppGlutWindow window;
 	ofSetupOpenGL(&window, 1024, 768, OF_WINDOW);
-	ofRunApp(new testApp());
+	ofRunApp(app);
 }
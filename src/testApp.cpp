@@ -1,5 +1,11 @@
 #include "testApp.h"
-#include "MSASpaceTime.h"
+#include "MSASlitScan.h"
+#include "MSASlitScanPipeline.h"
+#include "MSAStats.h"
+#include "MSATrace.h"
+#include "MSAPlyWriter.h"
+#include "MSACompressedDepthFrameStore.h"
+#include "MSAMmapDepthFrameStore.h"
 
 float nearThreshold = 0;
 float farThreshold = 3000;
@@ -14,152 +20,56 @@ int numScanFrames = 240;    // duration (in frames) for full scan
 ofVec3f spaceBoundaryMin    = ofVec3f(-400, -400, 400);
 ofVec3f spaceBoundaryMax    = ofVec3f(400, 400, farThreshold);
 
-// spatial resolution for space time continuum
-ofVec3f spaceNumCells;
-
 
 bool doSaveMesh = false;
 bool doPause = false;
 bool doDrawPointCloud = true;
 bool doSlitScan = true;
 bool doDebugInfo = false;
+bool doCompactHistory = false;  // store history frames quantized (10 bytes per point instead of 28)
+bool doSparseHistory = false;   // store only the occupied cells of history frames
+bool doAdaptive = false;        // compose through an octree refined where the gradient changes (256 x 256 x 256 at the finest)
+int adaptiveMaxLeaves = 8192;   // octree leaf budget per frame
+bool doRawHistory = false;      // keep history as depth images and bin them when composing (needs a depth camera)
 
 bool usingKinect;   // using kinect or webcam
 
 int gradientMode = 0;
-string gradientModeStr = "";
+float cellScale = 1;    // multiplier on the gradient mode's cells on each axis it scans along
+
+int frameQueueCapacity = 4;     // captured frames waiting for the ingest thread
+msa::FrameDropPolicy frameDropPolicy = msa::FRAME_DROP_OLDEST;
 
 int kinectAngle;
 float inputWidth, inputHeight;
 
-msa::SpaceTime<ofMesh> spaceTime;   // space time continuum
-
-ofMesh mesh;    // final mesh
-
-
-//--------------------------------------------------------------
-void fillMeshFromKinect(ofMesh &m, ofxKinect &kinect) {
-    ofVec3f maxP(-10000, -10000, -10000);
-    ofVec3f minP( 10000,  10000,  10000);
-    for(int j=0; j<kinect.getHeight(); j += pixelStep) {
-        for(int i=0; i<kinect.getWidth(); i += pixelStep) {
-            ofVec3f p = kinect.getWorldCoordinateAt(i, j);
-            if(ofInRange(p.z, nearThreshold, farThreshold) && kinect.getDistanceAt(i, j) > 0) {
-                m.addVertex(p);
-                m.addColor(kinect.getColorAt(i, j));
-                
-                if(doDebugInfo) {
-                    if(p.x < minP.x) minP.x = p.x;
-                    if(p.x > maxP.x) maxP.x = p.x;
-                    
-                    if(p.y < minP.y) minP.y = p.y;
-                    if(p.y > maxP.y) maxP.y = p.y;
-                    
-                    if(p.z < minP.z) minP.z = p.z;
-                    if(p.z > maxP.z) maxP.z = p.z;
-                }
-                
-            }
-        }
-    }
-    if(doDebugInfo) printf("Boundaries: (%f, %f, %f) - (%f, %f, %f)\n", minP.x, minP.y, minP.z, maxP.x, maxP.y, maxP.z);
-}
-
+msa::SlitScan slitScan;             // space time continuum and the gradient composing it
+msa::SlitScanPipeline pipeline;     // runs slitScan on ingest and compose threads
+msa::DepthFrame captureFrame;       // most recent grabbed frame, handed to the pipeline
+msa::Stats stats;                   // per stage frame times of the app and slitScan
+msa::Tracer tracer;                 // per stage spans of all threads, recorded on demand
+msa::DepthRecorder recorder;        // records captured frames to disk on demand
+msa::PlyExporter plyExporter;       // saves meshes in the background
+msa::CompressedDepthFrameStore compressedStore; // raw history frames with --compress
+msa::MmapDepthFrameStore diskStore;             // or with --disk
 
-//--------------------------------------------------------------
-// if kinect isn't available, just use webcam for testing (use brightness for depth value)
-void fillMeshFromPixels(ofMesh &m, ofPixelsRef pixelsRef) {
-    ofVec3f maxP(-10000, -10000, -10000);
-    ofVec3f minP( 10000,  10000,  10000);
-    for(int j=0; j<pixelsRef.getHeight(); j += pixelStep) {
-        for(int i=0; i<pixelsRef.getWidth(); i += pixelStep) {
-            ofColor c = pixelsRef.getColor(i, j);
-            ofVec3f p;
-            p.x = ofMap(i, 0, pixelsRef.getWidth(), spaceBoundaryMin.x, spaceBoundaryMax.x);
-            p.y = ofMap(j, 0, pixelsRef.getHeight(), spaceBoundaryMin.y, spaceBoundaryMax.y);
-            p.z = ofMap(c.getBrightness(), 255, 0, webcamNear, webcamFar);
-            if(ofInRange(p.z, nearThreshold, farThreshold)) {
-                m.addVertex(p);
-                m.addColor(c);
-                
-                if(doDebugInfo) {
-                    if(p.x < minP.x) minP.x = p.x;
-                    if(p.x > maxP.x) maxP.x = p.x;
-                    
-                    if(p.y < minP.y) minP.y = p.y;
-                    if(p.y > maxP.y) maxP.y = p.y;
-                    
-                    if(p.z < minP.z) minP.z = p.z;
-                    if(p.z > maxP.z) maxP.z = p.z;
-                }
-                
-            }
-        }
-    }
-    if(doDebugInfo) printf("Boundaries: (%f, %f, %f) - (%f, %f, %f)\n", minP.x, minP.y, minP.z, maxP.x, maxP.y, maxP.z);
-}
 
 //--------------------------------------------------------------
 void setGradientMode(int g) {
     gradientMode = g;
-    spaceTime.clear();
-
+    slitScan.setGradientMode(gradientMode);
+    ofVec3f n = msa::SlitScan::getGradientModeNumCells(gradientMode);
+    if(cellScale != 1) slitScan.setNumCells(ofVec3f(n.x > 1 ? n.x * cellScale : 1, n.y > 1 ? n.y * cellScale : 1, n.z > 1 ? n.z * cellScale : 1));
+}
 
-    switch(gradientMode) {
-        case 1:
-            gradientModeStr = "left-right";
-            spaceNumCells.set(500, 1, 1);
-            break;
-            
-        case 2:
-            gradientModeStr = "right-left";
-            spaceNumCells.set(500, 1, 1);
-            break;
-            
-        case 3:
-            gradientModeStr = "top-bottom";
-            spaceNumCells.set(1, 500, 1);
-            break;
-            
-        case 4:
-            gradientModeStr = "bottom-top";
-            spaceNumCells.set(1, 500, 1);
-            break;
-            
-        case 5:
-            gradientModeStr = "front-back";
-            spaceNumCells.set(1, 1, 500);
-            break;
-            
-        case 6:
-            gradientModeStr = "back-front";
-            spaceNumCells.set(1, 1, 500);
-            break;
-            
-        case 7:
-            gradientModeStr = "spherical";
-            spaceNumCells.set(30, 30, 30);
-            break;
-            
-        case 8:
-            gradientModeStr = "random";
-            spaceNumCells.set(40, 40, 40);
-            break;
-            
-        case 9:
-            gradientModeStr = "oldest";
-            spaceNumCells.set(2);
-            break;
-            
-        default:
-            gradientModeStr = "most recent";
-            spaceNumCells.set(2);
-            break;
-            
-            
+//--------------------------------------------------------------
+string getDropPolicyName(int p) {
+    switch(p) {
+        case msa::FRAME_DROP_OLDEST: return "drop oldest";
+        case msa::FRAME_DROP_NEWEST: return "drop newest";
+        case msa::FRAME_BLOCK: return "block";
     }
-    
-    ofLog(OF_LOG_VERBOSE, "setGradientMode: " + ofToString(gradientMode) + " " + gradientModeStr + " (" + ofToString(spaceNumCells.x) + ", " + ofToString(spaceNumCells.y) + ", " + ofToString(spaceNumCells.z) + ")");
+    return "";
 }
 
 
@@ -171,27 +81,71 @@ void testApp::setup() {
 	// enable depth->video image calibration
 	kinect.setRegistration(true);
     
-	usingKinect = kinect.init();
+    bool usingPlayer = !playPath.empty() && player.load(playPath);
+    if(usingPlayer) {
+        ofLog(OF_LOG_VERBOSE, "USING RECORDING " + playPath);
+        player.setRealtime(playRealtime);
+        depthSource = &player;
+    }
+    
+	usingKinect = !usingPlayer && !useSynthetic && kinect.init();
     if(usingKinect) {
         ofLog(OF_LOG_VERBOSE, "USING KINECT");
         usingKinect = kinect.open();		// opens first available kinect
         
         kinectAngle = kinect.getTargetCameraTiltAngle();
-        grabber = &kinect;
-        inputWidth = kinect.getWidth();
-        inputHeight = kinect.getHeight();
+        if(usingKinect) {
+            kinectSource.setup(kinect);
+            depthSource = &kinectSource;
+        }
     }
     
-    if(usingKinect == false) {
+    if(usingKinect == false && useSynthetic == false && usingPlayer == false) {
         ofLog(OF_LOG_VERBOSE, "USING VIDEO GRABBER");
-        videoGrabber.initGrabber(640, 480);
-        grabber = &videoGrabber;
-        inputWidth = videoGrabber.getWidth();
-        inputHeight = videoGrabber.getHeight();
+        if(videoGrabber.initGrabber(640, 480)) {
+            grabber = &videoGrabber;
+            inputWidth = videoGrabber.getWidth();
+            inputHeight = videoGrabber.getHeight();
+        } else {
+            useSynthetic = true;    // no camera at all
+        }
     }
     
-    spaceTime.setMaxFrames(numScanFrames);
+    if(useSynthetic) {
+        ofLog(OF_LOG_VERBOSE, "USING SYNTHETIC DEPTH");
+        syntheticSource.setup(syntheticWidth, syntheticHeight, syntheticFps, syntheticSeed);
+        syntheticSource.setRealtime(playRealtime);
+        depthSource = &syntheticSource;
+    }
+    
+    if(depthSource) {
+        grabber = depthSource;
+        inputWidth = depthSource->getWidth();
+        inputHeight = depthSource->getHeight();
+        slitScan.getDepthToWorld().setup(*depthSource, inputWidth, inputHeight);
+    }
+    
+    slitScan.setStats(&stats);
+    slitScan.setTracer(&tracer);
+    tracer.setThreadName("main");
+    slitScan.setup();
+    if(!diskHistoryPath.empty()) {
+        diskStore.setPath(diskHistoryPath);
+        diskStore.setMaxResidentBytes((size_t)diskHistoryMaxResidentMB * 1024 * 1024);
+        slitScan.setFrameStore(&diskStore);
+    } else if(compressHistory) {
+        slitScan.setFrameStore(&compressedStore);
+    }
+    slitScan.setThresholds(nearThreshold, farThreshold);
+    slitScan.setWebcamRange(webcamNear, webcamFar);
+    slitScan.setBoundaries(spaceBoundaryMin, spaceBoundaryMax);
+    slitScan.setPixelStep(pixelStep);
+    slitScan.setNumScanFrames(numScanFrames);
     setGradientMode(0);
+    
+    pipeline.setDropPolicy(frameDropPolicy);
+    pipeline.setup(slitScan, frameQueueCapacity);
+    plyExporter.setup();
 }
 
 //--------------------------------------------------------------
@@ -199,141 +153,44 @@ void testApp::update() {
 	
 	ofBackground(100, 100, 100);
 	
-	grabber->update();
-    
-    if(doPause == false) {
-        if(grabber->isFrameNew()) {
-
-            if(doSlitScan) {
-                // construct space time continuum
-                msa::SpaceT<ofMesh> *space = new msa::SpaceT<ofMesh>(spaceNumCells, spaceBoundaryMin, spaceBoundaryMax);
-                
-                ofPixelsRef pixelsRef = grabber->getPixelsRef();
-                // iterate all vertices of mesh, and add to relevant quantum cells
-                for(int j=0; j<inputHeight; j += pixelStep) {
-                    for(int i=0; i<inputWidth; i += pixelStep) {
-                        ofVec3f p;
-                        ofFloatColor c;
-                        bool doIt;
-                        if(usingKinect) {
-                            p = kinect.getWorldCoordinateAt(i, j);
-                            c = kinect.getColorAt(i, j);
-                            doIt = kinect.getDistanceAt(i, j) > 0;
-                        } else {
-                            c = pixelsRef.getColor(i, j);
-                            p.x = ofMap(i, 0, pixelsRef.getWidth(), spaceBoundaryMin.x, spaceBoundaryMax.x);
-                            p.y = ofMap(j, 0, pixelsRef.getHeight(), spaceBoundaryMin.y, spaceBoundaryMax.y);
-                            p.z = ofMap(c.getBrightness(), 1, 0, webcamNear, webcamFar);
-                            doIt = true;
-                        }
-                        if(ofInRange(p.z, nearThreshold, farThreshold) && doIt) {
-                            ofVec3f index = space->getIndexForPosition(p);
-                            ofMesh &cellMesh = space->getDataAtIndex(index);
-                            cellMesh.addVertex(p);
-                            cellMesh.addColor(c);
-                            if(doDebugInfo) {
-                                int i = index.x;
-                                int j = index.y;
-                                int k = index.z;
-                                if(cellMesh.getNumVertices()>0) printf("UPDATE SPACE pos: %f, %f, %f, cell: %i, %i, %i, numVertices: %i\n", p.x, p.y, p.z, i, j, k, cellMesh.getNumVertices());
-                            }
-                        }
-                    }
-                }
-                
-                // add space to space time continuum
-                spaceTime.addSpace(space);
-                
-                // update mesh
-                mesh.clear();
-                for(int i=0; i<spaceNumCells.x; i++) {
-                    for(int j=0; j<spaceNumCells.y; j++) {
-                        for(int k=0; k<spaceNumCells.z; k++) {
-                            float t;
-                            switch(gradientMode) {
-                                case 0:
-                                    t = 0;  // use most recent mesh
-                                    break;
-                                    
-                                case 1:
-                                    t = i * 1.0f/spaceNumCells.x; // left to right
-                                    break;
-                                    
-                                case 2:
-                                    t = 1.0f - i * 1.0f/spaceNumCells.x; // right to left
-                                    break;
-                                    
-                                case 3:
-                                    t = j * 1.0f/spaceNumCells.y; // up to down
-                                    break;
-                                    
-                                case 4:
-                                    t = 1.0f - j * 1.0f/spaceNumCells.y; // down to up
-                                    break;
-                                    
-                                case 5:
-                                    t = k * 1.0f/spaceNumCells.z; // front to back
-                                    break;
-                                    
-                                case 6:
-                                    t = 1.0f - k * 1.0f/spaceNumCells.z; //  back to front
-                                    break;
-                                    
-                                case 7:
-                                {
-                                    // spherical
-                                    float tx = i/spaceNumCells.x * 2 - 1;
-                                    float ty = j/spaceNumCells.y * 2 - 1;
-                                    float tz = k/spaceNumCells.z * 2 - 1;
-                                    t = tx * tx + ty * ty + tz * tz;
-//                                    t = sqrt(t);
-                                }
-                                    break;
-                                    
-                                case 8:
-                                    t = ofRandomuf();
-                                    break;
-                                    
-                                case 9:
-                                    t = 1;
-                                    break;
-                                    
-                            }
-                            
-                            t = ofClamp(t, 0, 1);
-                            
-                            ofMesh &cellMesh = spaceTime.getSpaceAtTime(t)->getDataAtIndex(i, j, k);
-                            
-                            mesh.addVertices(cellMesh.getVertices());
-                            mesh.addColors(cellMesh.getColors());
-                            
-                            if(doDebugInfo) {
-                                if(cellMesh.getNumVertices()>0) printf("UPDATE MESH cell: %i, %i, %i, time: %f, numVertices: %i\n", i, j, k, t, cellMesh.getNumVertices());
-                            }
-                        } // k
-                    } // j
-                } // i
-                
-            } else {
-                mesh.clear();
-                if(usingKinect) fillMeshFromKinect(mesh, kinect);
-                else fillMeshFromPixels(mesh, grabber->getPixelsRef());
-            }
+    // capture new frames and hand them to the ingest thread
+    {
+        msa::ScopedTimer timer(&stats, "grab");
+        msa::ScopedTrace trace(&tracer, "grab", ofGetFrameNum(), gradientMode);
+        grabber->update();
+        
+        if(doPause == false && grabber->isFrameNew()) {
+            if(depthSource) captureFrame.setFromPixels(depthSource->getRawDepthPixels(), depthSource->getPixels(), inputWidth, inputHeight);
+            else captureFrame.setFromPixels(NULL, videoGrabber.getPixels(), inputWidth, inputHeight);
+            captureFrame.timestamp = ofGetElapsedTimeMicros();
+            captureFrame.frameNum = ofGetFrameNum();
+            if(recorder.isRecording()) recorder.addFrame(captureFrame);    // copies, pushFrame takes the images
+            pipeline.pushFrame(captureFrame);
         }
     }
     
+    // pick up the most recently composed mesh
+    {
+        msa::ScopedTrace trace(&tracer, "pick up mesh", ofGetFrameNum(), gradientMode);
+        pipeline.update();
+        trace.setPoints(pipeline.getMesh().getNumVertices());
+    }
+    ofMesh &mesh = pipeline.getMesh();
+    
     if(doSaveMesh) {
         doSaveMesh = false;
-        mesh.save("mesh_" + ofGetTimestampString() + ".ply");
+        plyExporter.save("mesh_" + ofGetTimestampString() + ".ply", mesh.getVertices(), mesh.getColors());
     }
 }
 
 //--------------------------------------------------------------
 void testApp::draw() {
+    msa::ScopedTimer timer(&stats, "draw");
+    msa::ScopedTrace trace(&tracer, "draw", ofGetFrameNum(), gradientMode);
     
     ofSetColor(255, 255, 255);
 
-    if(usingKinect) kinect.draw(ofGetWidth()-160, 0, 160, 120);
+    if(depthSource) depthSource->draw(ofGetWidth()-160, 0, 160, 120);
     else videoGrabber.draw(ofGetWidth()-160, 0, 160, 120);
     
     if(doDrawPointCloud) {
@@ -348,7 +205,13 @@ void testApp::draw() {
         ofTranslate(0, 0, -1000); // center the points a bit
         glEnable(GL_DEPTH_TEST);
         
-        mesh.drawVertices();
+        {
+            // vertex and color arrays are sent to the gpu during the draw call
+            msa::ScopedTimer timer(&stats, "mesh upload");
+            msa::ScopedTrace trace(&tracer, "mesh upload", ofGetFrameNum(), gradientMode);
+            trace.setPoints(pipeline.getMesh().getNumVertices());
+            pipeline.getMesh().drawVertices();
+        }
 
         glDisable(GL_DEPTH_TEST);
         ofPopMatrix();
@@ -363,13 +226,34 @@ void testApp::draw() {
     << "nearThreshold (,.)    : " << nearThreshold << endl
     << "farThreshold (<>)     : " << farThreshold << endl
     << "fps                   : " << ofGetFrameRate() << endl
+    << "numScanFrames (-=)    : " << numScanFrames << endl
+    << "doCompactHistory (q)  : " << doCompactHistory << endl
+    << "doSparseHistory (z)   : " << doSparseHistory << endl
+    << "cells ([])            : " << slitScan.getNumCells().x << " x " << slitScan.getNumCells().y << " x " << slitScan.getNumCells().z << endl
+    << "doAdaptive (a)        : " << doAdaptive << endl
+    << "octree leaves ({})    : " << slitScan.getNumLeaves() << " / " << adaptiveMaxLeaves << endl
+    << "doRawHistory (h)      : " << doRawHistory << " (" << slitScan.getNumRowsRead() << " rows read)" << endl
+    << "history decode        : " << (compressHistory ? ofToString(compressedStore.getNumTilesDecoded()) + " tiles (" + ofToString(compressedStore.getNumCacheHits()) + " cached), " + ofToString(compressedStore.getDecodeMicros() / 1000.0f) + " ms" : "off (--compress)") << endl
+    << "history file (MB)     : " << (diskHistoryPath.empty() ? "off (--disk)" : ofToString(diskStore.getBytesMapped() / (1024 * 1024)) + ", " + ofToString(diskStore.getNumPrefetched()) + " prefetches, " + ofToString(diskStore.getNumEvicted()) + " dropped") << endl
+    << "history (MB)          : " << slitScan.getHistoryBytes() / (1024.0f * 1024.0f) << (slitScan.getHistoryFailed() ? " (STORE FAILED, see log)" : "") << endl
+    << "pool hits / misses    : " << slitScan.getSpacePool().getNumHits() << " / " << slitScan.getSpacePool().getNumMisses() << endl
+    << "pool retained (MB)    : " << slitScan.getSpacePool().getBytesRetained() / (1024.0f * 1024.0f) << endl
+    << "frames queued/dropped : " << pipeline.getNumFramesQueued() << " / " << pipeline.getNumFramesDropped() << endl
+    << "queue max depth       : " << pipeline.getQueueHighWaterMark() << " / " << frameQueueCapacity << endl
+    << "dropPolicy (o)        : " << getDropPolicyName(frameDropPolicy) << endl
     << "kinectAngle (UP/DOWN) : " << kinectAngle << endl
     << "doPause (p)           : " << doPause << endl
     << "doSlitScan (s)        : " << doSlitScan << endl
     << "doDrawPointCloud (c)  : " << doDrawPointCloud << endl
     << "doDebugInfo (d)       : " << doDebugInfo << endl
+    << "save stats csv (f)" << endl
+    << "trace (t), save (T)   : " << (tracer.isRecording() ? "recording " : "off ") << tracer.getNumEvents() << " events" << endl
+    << "save mesh (S)         : " << plyExporter.getStatus() << (plyExporter.getNumPending() ? " (" + ofToString(plyExporter.getNumPending()) + " pending)" : "") << endl
+    << "record (r)            : " << (recorder.isRecording() ? "recording " : "off ") << recorder.getNumFramesWritten() << " frames, " << recorder.getBytesWritten() / (1024.0f * 1024.0f) << " MB, " << recorder.getNumFramesDropped() << " dropped" << endl
+    << endl
+    << stats.getReport()
     << endl
-    << "gradientMode (0-9)    : " << gradientMode << ": " << gradientModeStr << endl
+    << "gradientMode (0-9)    : " << gradientMode << ": " << msa::SlitScan::getGradientModeName(gradientMode) << endl
     << "   0: most recent" << (gradientMode == 0 ? " * " : "" ) << endl
     << "   1: left-right" << (gradientMode == 1 ? " * " : "" ) << endl
     << "   2: right-left" << (gradientMode == 2 ? " * " : "" ) << endl
@@ -387,9 +271,25 @@ void testApp::draw() {
 
 //--------------------------------------------------------------
 void testApp::exit() {
+    recorder.stop();
+    plyExporter.stop();
+    pipeline.stop();
+    slitScan.stop();
     kinect.close();
 }
 
+//--------------------------------------------------------------
+// per 640x480 frame of the synthetic scene: binned points take about 3 MB, compact points 1.1 MB, raw frames 1.5 MB
+// (750 KB compressed, plus the tile cache) of memory, so the in-memory histories stay within about 2 GB
+// frames on disk only take disk space (27 GB for 30720)
+int testApp::getMaxScanFrames() {
+    if(doRawHistory) {
+        if(!diskHistoryPath.empty()) return 30720;    // 17 minutes at 30 fps
+        return compressHistory ? 1920 : 960;
+    }
+    return doCompactHistory ? 1920 : 480;
+}
+
 //--------------------------------------------------------------
 void testApp::keyPressed (int key) {
     switch (key) {
@@ -414,24 +314,28 @@ void testApp::keyPressed (int key) {
             farThreshold += 10;
 			if (farThreshold > 10000) farThreshold = 10000;
             printf("farThreshold: %f\n", farThreshold);
+            slitScan.setThresholds(nearThreshold, farThreshold);
             break;
             
         case '<':
             farThreshold -= 10;
 			if (farThreshold < 0) farThreshold = 0;
             printf("farThreshold: %f\n", farThreshold);
+            slitScan.setThresholds(nearThreshold, farThreshold);
             break;
             
         case '.':
             nearThreshold += 10;
 			if (nearThreshold > 10000) nearThreshold = 10000;
             printf("nearThreshold: %f\n", farThreshold);
+            slitScan.setThresholds(nearThreshold, farThreshold);
             break;
             
         case ',':
             nearThreshold -= 10;
 			if (nearThreshold < 0) nearThreshold = 0;
             printf("nearThreshold: %f\n", farThreshold);
+            slitScan.setThresholds(nearThreshold, farThreshold);
             break;
             
         case 'S':
@@ -440,14 +344,105 @@ void testApp::keyPressed (int key) {
             
         case 's':
             doSlitScan ^= true;
+            pipeline.setSlitScan(doSlitScan);
             break;
             
         case 'c':
             doDrawPointCloud ^= true;
             break;
             
+        case 'f':
+            stats.saveCsv("stats_" + ofGetTimestampString() + ".csv");
+            break;
+            
+        case 't':
+            tracer.setRecording(!tracer.isRecording());
+            break;
+            
+        case 'T':
+            tracer.save("trace_" + ofGetTimestampString() + ".json");
+            break;
+            
+        case 'r':
+            // the depth and ray tables are all that's needed to replay through the pipeline, so webcam input isn't recorded
+            if(recorder.isRecording()) recorder.stop();
+            else if(depthSource) recorder.start("recording_" + ofGetTimestampString() + ".msadepth", slitScan.getDepthToWorld());
+            break;
+            
+        case 'o':
+            frameDropPolicy = (msa::FrameDropPolicy)((frameDropPolicy + 1) % 3);
+            pipeline.setDropPolicy(frameDropPolicy);
+            break;
+            
         case 'd':
             doDebugInfo ^= true;
+            slitScan.setDebugInfo(doDebugInfo);
+            break;
+            
+        case 'q':
+            doCompactHistory ^= true;
+            slitScan.setCompact(doCompactHistory);
+            // a longer scan than the new mode's history fits is cut back to it
+            if(numScanFrames > getMaxScanFrames()) {
+                numScanFrames = getMaxScanFrames();
+                slitScan.setNumScanFrames(numScanFrames);
+            }
+            break;
+            
+        case 'z':
+            doSparseHistory ^= true;
+            slitScan.setSparse(doSparseHistory);
+            break;
+            
+        case 'a':
+            doAdaptive ^= true;
+            slitScan.setAdaptive(doAdaptive);
+            break;
+            
+        case 'h':
+            doRawHistory ^= true;
+            slitScan.setRawHistory(doRawHistory);
+            if(numScanFrames > getMaxScanFrames()) {
+                numScanFrames = getMaxScanFrames();
+                slitScan.setNumScanFrames(numScanFrames);
+            }
+            break;
+            
+        case '{':
+            adaptiveMaxLeaves /= 2;
+            if(adaptiveMaxLeaves < 512) adaptiveMaxLeaves = 512;
+            slitScan.setAdaptiveMaxLeaves(adaptiveMaxLeaves);
+            break;
+            
+        case '}':
+            adaptiveMaxLeaves *= 2;
+            if(adaptiveMaxLeaves > 1048576) adaptiveMaxLeaves = 1048576;
+            slitScan.setAdaptiveMaxLeaves(adaptiveMaxLeaves);
+            break;
+            
+        case '[':
+            cellScale /= 2;
+            if(cellScale < 0.125f) cellScale = 0.125f;
+            setGradientMode(gradientMode);
+            break;
+            
+        case ']':
+            // fine 3D grids need doSparseHistory to fit in memory
+            cellScale *= 2;
+            if(cellScale > 4) cellScale = 4;
+            setGradientMode(gradientMode);
+            break;
+            
+        case '-':
+            numScanFrames /= 2;
+            if(numScanFrames < 30) numScanFrames = 30;
+            slitScan.setNumScanFrames(numScanFrames);
+            break;
+            
+        case '=':
+            numScanFrames *= 2;
+            if(numScanFrames > getMaxScanFrames()) numScanFrames = getMaxScanFrames();
+            slitScan.setNumScanFrames(numScanFrames);
             break;
             
         case OF_KEY_UP:
@@ -2,9 +2,24 @@
 
 #include "ofMain.h"
 #include "ofxKinect.h"
+#include "MSAKinectDepthSource.h"
+#include "MSASyntheticDepthSource.h"
+#include "MSADepthRecorder.h"
 
 class testApp : public ofBaseApp {
 public:
+    testApp() {
+        useSynthetic = false;
+        syntheticWidth = 640;
+        syntheticHeight = 480;
+        syntheticFps = 30;
+        syntheticSeed = 0;
+        playRealtime = true;
+        compressHistory = false;
+        diskHistoryMaxResidentMB = 1024;
+        depthSource = NULL;
+    }
+    
 	void setup();
 	void update();
 	void draw();
@@ -12,8 +27,32 @@ public:
 	
 	void keyPressed(int key);
 	
+	// longest scan '=' goes to, so the history of the current mode fits
+	int getMaxScanFrames();
+	
 	ofxKinect kinect;
     ofVideoGrabber videoGrabber;
+    msa::KinectDepthSource kinectSource;
+    msa::SyntheticDepthSource syntheticSource;
+    msa::DepthPlayer player;
+    msa::DepthSource *depthSource;  // kinect, synthetic or recording, NULL when using the webcam
     ofBaseVideo *grabber;
+    
+    // use a synthetic scene instead of the kinect (also used when there's no kinect or webcam)
+    bool useSynthetic;
+    int syntheticWidth, syntheticHeight;
+    float syntheticFps;
+    unsigned int syntheticSeed;
+    
+    // play a recording made with 'r' instead of the kinect, at the recorded rate or as fast as frames are taken
+    string playPath;
+    bool playRealtime;      // also for synthetic depth
+    
+    // keep the raw history ('h') compressed instead of as plain images
+    bool compressHistory;
+    
+    // or in a memory mapped file (on a local SSD) of which at most diskHistoryMaxResidentMB stay mapped in, for many minutes
+    string diskHistoryPath;
+    int diskHistoryMaxResidentMB;
 	ofEasyCam easyCam;
 };
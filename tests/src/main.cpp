@@ -0,0 +1,237 @@
+// checks of the engine's optimized kernels against their reference implementations, and of the memory its Spaces allocate
+// prints one line per check and exits non-zero if any of them fails
+// see ../readme.md for usage
+
+#include "ofMain.h"
+#include "MSADepthToWorld.h"
+#include "MSASpaceTime.h"
+
+
+//--------------------------------------------------------------
+// largest block allocated with new since it was last reset, to catch allocations which are freed again right away
+size_t largestAllocation = 0;
+
+void* operator new(size_t size) throw(std::bad_alloc) {
+    if(size > largestAllocation) largestAllocation = size;
+    void *p = malloc(size ? size : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+
+#ifndef TARGET_WIN32
+void operator delete(void *p) throw() __attribute__((noinline));   // so gcc doesn't take its free for a mismatch with the builtin new
+#endif
+void operator delete(void *p) throw() {
+    free(p);
+}
+
+
+//--------------------------------------------------------------
+// deterministic pseudo random numbers, so every run checks the same inputs
+class Random {
+public:
+    Random(unsigned int seed = 1) : state(seed) {}
+
+    unsigned int next() {
+        state = state * 1664525 + 1013904223;
+        return state >> 8;
+    }
+
+    float uniform(float a, float b) {
+        return ofLerp(a, b, next() / 16777216.0f);
+    }
+
+protected:
+    unsigned int state;
+};
+
+
+//--------------------------------------------------------------
+// outputs of one converted row (or range of a row)
+struct ConvertedRow {
+    vector<float> x, y, z;
+    vector<unsigned char> valid;
+    int numValid;
+
+    void resize(int n) {
+        // one guard value past the end, to catch writes beyond the pixels converted
+        x.assign(n + 1, -1);
+        y.assign(n + 1, -1);
+        z.assign(n + 1, -1);
+        valid.assign(n + 1, 2);
+        numValid = -1;
+    }
+};
+
+//--------------------------------------------------------------
+// first output that differs (bitwise for positions, including the guard value), -1 if none
+int findMismatch(const ConvertedRow &a, const ConvertedRow &b) {
+    for(int o=0; o<a.x.size(); o++) {
+        if(memcmp(&a.x[o], &b.x[o], sizeof(float)) || memcmp(&a.y[o], &b.y[o], sizeof(float)) || memcmp(&a.z[o], &b.z[o], sizeof(float)) || a.valid[o] != b.valid[o]) return o;
+    }
+    return -1;
+}
+
+//--------------------------------------------------------------
+// print what differs between optimized and reference output of a row, returns false if anything does
+bool compareRows(string name, const ConvertedRow &optimized, const ConvertedRow &reference) {
+    int o = findMismatch(optimized, reference);
+    if(o >= 0) {
+        printf("FAIL %s: output %d differs (x %g / %g, y %g / %g, z %g / %g, valid %d / %d)\n", name.c_str(), o,
+               optimized.x[o], reference.x[o], optimized.y[o], reference.y[o], optimized.z[o], reference.z[o], optimized.valid[o], reference.valid[o]);
+        return false;
+    }
+    if(optimized.numValid != reference.numValid) {
+        printf("FAIL %s: %d valid pixels instead of %d\n", name.c_str(), optimized.numValid, reference.numValid);
+        return false;
+    }
+    return true;
+}
+
+
+//--------------------------------------------------------------
+// DepthToWorld::convertRow / convertRowRange (SIMD for step 1) against convertRowScalar: random rays and depths
+// (with zeros, the thresholds themselves and values beyond them), odd widths, all steps up to 5 and row ranges
+// starting and ending anywhere, so the vector loops and the scalar tails are both covered
+bool checkDepthToWorld() {
+    Random random(7);
+    int widths[] = { 1, 7, 8, 9, 15, 16, 17, 33, 320, 639, 640 };
+    int numWidths = sizeof(widths) / sizeof(widths[0]);
+    int height = 3;
+    float nearThreshold = 500;
+    float farThreshold = 3000;
+    int numChecks = 0;
+    int numFailed = 0;
+
+    for(int w=0; w<numWidths; w++) {
+        int width = widths[w];
+        msa::DepthToWorld depthToWorld;
+        depthToWorld.allocate(width, height);
+        for(int p=0; p<width * height; p++) {
+            depthToWorld.getRaysX()[p] = random.uniform(-0.6f, 0.6f);
+            depthToWorld.getRaysY()[p] = random.uniform(-0.45f, 0.45f);
+        }
+
+        vector<unsigned short> depth(width);
+        ConvertedRow optimized, reference;
+        for(int j=0; j<height; j++) {
+            for(int i=0; i<width; i++) {
+                switch(random.next() % 6) {
+                    case 0: depth[i] = 0; break;
+                    case 1: depth[i] = random.next() % 2 ? nearThreshold : farThreshold; break;
+                    case 2: depth[i] = random.next() % 65536; break;
+                    default: depth[i] = nearThreshold + random.next() % (int)(farThreshold - nearThreshold); break;
+                }
+            }
+
+            for(int step=1; step<=5; step++) {
+                // whole row
+                int n = (width + step - 1) / step;
+                optimized.resize(n);
+                reference.resize(n);
+                optimized.numValid = depthToWorld.convertRow(j, &depth[0], step, nearThreshold, farThreshold, &optimized.x[0], &optimized.y[0], &optimized.z[0], &optimized.valid[0]);
+                reference.numValid = depthToWorld.convertRowScalar(j, &depth[0], step, nearThreshold, farThreshold, &reference.x[0], &reference.y[0], &reference.z[0], &reference.valid[0]);
+                numChecks++;
+                if(!compareRows("convertRow width " + ofToString(width) + " row " + ofToString(j) + " step " + ofToString(step), optimized, reference)) numFailed++;
+
+                // ranges of the row, begin a multiple of step
+                for(int r=0; r<8; r++) {
+                    int iBegin = random.next() % width / step * step;
+                    int iEnd = iBegin + 1 + random.next() % (width - iBegin);
+                    n = (iEnd - iBegin + step - 1) / step;
+                    optimized.resize(n);
+                    reference.resize(n);
+                    optimized.numValid = depthToWorld.convertRowRange(j, &depth[0], iBegin, iEnd, step, nearThreshold, farThreshold, &optimized.x[0], &optimized.y[0], &optimized.z[0], &optimized.valid[0]);
+                    reference.numValid = depthToWorld.convertRowScalar(j, &depth[0], iBegin, iEnd, step, nearThreshold, farThreshold, &reference.x[0], &reference.y[0], &reference.z[0], &reference.valid[0]);
+                    numChecks++;
+                    if(!compareRows("convertRowRange width " + ofToString(width) + " row " + ofToString(j) + " step " + ofToString(step)
+                                    + " pixels [" + ofToString(iBegin) + ", " + ofToString(iEnd) + ")", optimized, reference)) numFailed++;
+                }
+            }
+        }
+    }
+
+    printf("%s depthToWorld: %d of %d rows match the scalar path\n", numFailed ? "FAIL" : "ok  ", numChecks - numFailed, numChecks);
+    return numFailed == 0;
+}
+
+
+//--------------------------------------------------------------
+// print whether a Space got from the pool stores its cells in the format asked for and never allocated dense offsets for
+// every cell on the way (4 bytes per cell, 64 MB for the 256^3 grid of an adaptive Space), returns false if not
+bool checkSpaceFormat(string name, msa::PointSpace *space, const msa::SpaceFormat &format) {
+    size_t denseBytes = (size_t)space->getNumCellsTotal() * sizeof(unsigned int);
+    if(largestAllocation >= denseBytes) {
+        printf("FAIL %s: allocated %d bytes at once, as many as dense offsets for %d cells\n", name.c_str(), (int)largestAllocation, space->getNumCellsTotal());
+        return false;
+    }
+    if(space->getCompact() != format.compact || space->getSparse() != format.sparse || space->getMortonOrder() != format.mortonOrder) {
+        printf("FAIL %s: wrong format (compact %d, sparse %d, morton %d)\n", name.c_str(), space->getCompact(), space->getSparse(), space->getMortonOrder());
+        return false;
+    }
+    if(space->getNumPoints() != 0 || space->getNumSlots() != 0) {
+        printf("FAIL %s: %d points in %d slots instead of none\n", name.c_str(), space->getNumPoints(), space->getNumSlots());
+        return false;
+    }
+    if(space->getBytesReserved() >= denseBytes) {
+        printf("FAIL %s: %d bytes reserved, as many as dense offsets for %d cells\n", name.c_str(), (int)space->getBytesReserved(), space->getNumCellsTotal());
+        return false;
+    }
+    return true;
+}
+
+//--------------------------------------------------------------
+// SpacePool::getSpace of sparse Spaces (with and without Morton order) on a fine grid, both new and recycled from a
+// dense Space of a coarse grid, so the format is applied before the cells are allocated on either path
+bool checkSparseSpaces() {
+    ofVec3f boundaryMin(-1000, -1000, 0);
+    ofVec3f boundaryMax(1000, 1000, 4000);
+    ofVec3f coarseCells(8, 8, 8);
+    ofVec3f fineCells(256, 256, 256);
+    msa::SpaceFormat formats[] = { msa::SpaceFormat(false, true, true), msa::SpaceFormat(true, true, true), msa::SpaceFormat(false, true, false) };
+    int numFormats = sizeof(formats) / sizeof(formats[0]);
+    int numChecks = 0;
+    int numFailed = 0;
+
+    for(int f=0; f<numFormats; f++) {
+        string name = "format " + ofToString(f);
+        msa::SpacePool<msa::PointSpace> pool;
+        largestAllocation = 0;
+        msa::PointSpace *space = pool.getSpace(fineCells, boundaryMin, boundaryMax, formats[f]);
+        numChecks++;
+        if(!checkSpaceFormat("new space " + name, space, formats[f])) numFailed++;
+        delete space;
+
+        pool.releaseSpace(pool.getSpace(coarseCells, boundaryMin, boundaryMax));
+        largestAllocation = 0;
+        space = pool.getSpace(fineCells, boundaryMin, boundaryMax, formats[f]);
+        numChecks++;
+        if(pool.getNumHits() != 1) {
+            printf("FAIL recycled space %s: not recycled\n", name.c_str());
+            numFailed++;
+        } else if(!checkSpaceFormat("recycled space " + name, space, formats[f])) {
+            numFailed++;
+        }
+        delete space;
+    }
+
+    printf("%s sparseSpaces: %d of %d sparse spaces allocate no dense offsets\n", numFailed ? "FAIL" : "ok  ", numChecks - numFailed, numChecks);
+    return numFailed == 0;
+}
+
+
+//--------------------------------------------------------------
+int main(int argc, char *argv[]) {
+#if defined(__AVX2__)
+    printf("DepthToWorld kernel: AVX2\n");
+#elif defined(__SSE2__)
+    printf("DepthToWorld kernel: SSE2\n");
+#else
+    printf("DepthToWorld kernel: scalar only\n");
+#endif
+
+    bool ok = true;
+    ok &= checkDepthToWorld();
+    ok &= checkSparseSpaces();
+    return ok ? 0 : 1;
+}